@@ -17,8 +17,7 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
-import QtQuick 6.0
-import QtQuick 6.0
+import QtQuick 6.3
 import QtQuick.Window 6.0
 import QtQuick.Layouts 6.0
 import QtQuick.Controls 6.0
@@ -101,6 +100,73 @@ Item {
         }
     }
 
+    Component {
+        id: filesPage
+
+        ColumnLayout {
+            Label {
+                Layout.fillWidth: true
+                Layout.margins: FishUI.Units.smallSpacing
+                text: Installer.files.loading ? qsTr("Reading package contents... %1 files").arg(Installer.files.fileCount)
+                                              : qsTr("%1 files").arg(Installer.files.fileCount)
+                color: FishUI.Theme.disabledTextColor
+            }
+
+            TreeView {
+                id: _treeView
+                Layout.fillWidth: true
+                Layout.fillHeight: true
+                clip: true
+                model: Installer.files
+
+                ScrollBar.vertical: ScrollBar {}
+
+                delegate: Item {
+                    id: _fileItem
+                    implicitWidth: _treeView.width
+                    implicitHeight: _fileName.implicitHeight + FishUI.Units.smallSpacing
+
+                    required property TreeView treeView
+                    required property bool expanded
+                    required property bool hasChildren
+                    required property int depth
+                    required property int row
+                    required property string display
+                    required property string path
+
+                    Label {
+                        id: _indicator
+                        x: _fileItem.depth * FishUI.Units.largeSpacing
+                        anchors.verticalCenter: parent.verticalCenter
+                        width: FishUI.Units.largeSpacing
+                        text: _fileItem.hasChildren ? (_fileItem.expanded ? "▾" : "▸") : ""
+                    }
+
+                    Label {
+                        id: _fileName
+                        anchors.left: _indicator.right
+                        anchors.right: parent.right
+                        anchors.verticalCenter: parent.verticalCenter
+                        text: _fileItem.display
+                        elide: Text.ElideMiddle
+                    }
+
+                    TapHandler {
+                        onTapped: _fileItem.treeView.toggleExpanded(_fileItem.row)
+                    }
+
+                    ToolTip.text: _fileItem.path
+                    ToolTip.visible: _hover.hovered
+                    ToolTip.delay: 500
+
+                    HoverHandler {
+                        id: _hover
+                    }
+                }
+            }
+        }
+    }
+
     ColumnLayout {
         anchors.fill: parent
         anchors.leftMargin: FishUI.Units.largeSpacing
@@ -131,6 +197,14 @@ Item {
             Layout.alignment: Qt.AlignTop | Qt.AlignHCenter
         }
 
+        Label {
+            id: queued
+            text: qsTr("%1 more package(s) will be installed together").arg(Installer.queuedFiles.length)
+            color: FishUI.Theme.disabledTextColor
+            Layout.alignment: Qt.AlignTop | Qt.AlignHCenter
+            visible: Installer.queuedFiles.length > 0
+        }
+
         Label {
             id: status
             text: Installer.preInstallMessage
@@ -139,25 +213,62 @@ Item {
             visible: text
         }
 
+        Label {
+            text: Installer.reinstallStatus
+            color: FishUI.Theme.disabledTextColor
+            Layout.alignment: Qt.AlignTop | Qt.AlignHCenter
+            visible: text
+        }
+
+        Label {
+            text: Installer.repositoryStatus
+            color: FishUI.Theme.disabledTextColor
+            Layout.alignment: Qt.AlignTop | Qt.AlignHCenter
+            visible: text
+        }
+
         Item {
             height: FishUI.Units.smallSpacing
         }
 
-//        TabBar {
-//            Layout.fillWidth: true
+        TabBar {
+            id: _tabBar
+            Layout.fillWidth: true
 
-//            TabButton {
-//                text: qsTr("Information")
-//            }
-//            TabButton {
-//                text: qsTr("Included Files")
-//            }
-//        }
+            TabButton {
+                text: qsTr("Information")
+            }
+            TabButton {
+                text: qsTr("Included Files")
+            }
+
+            // 第一次切换到文件列表时才开始读取
+            onCurrentIndexChanged: {
+                if (currentIndex === 1)
+                    Installer.files.load()
+            }
+        }
 
-        StackView {
+        StackLayout {
             Layout.fillHeight: true
             Layout.fillWidth: true
-            initialItem: informationPage
+            currentIndex: _tabBar.currentIndex
+
+            Loader {
+                sourceComponent: informationPage
+            }
+
+            Loader {
+                sourceComponent: filesPage
+            }
+        }
+
+        ProgressBar {
+            Layout.fillWidth: true
+            visible: Installer.downloadProgress >= 0
+            from: 0
+            to: 1
+            value: Installer.downloadProgress
         }
 
         RowLayout {
@@ -168,6 +279,12 @@ Item {
                 text: qsTr("Cancel")
                 onClicked: Qt.quit()
             }
+            Button {
+                Layout.fillWidth: true
+                text: qsTr("Repair")
+                visible: Installer.modifiedFiles.length > 0
+                onClicked: Installer.repair()
+            }
             Button {
                 Layout.fillWidth: true
                 text: Installer.isInstalled ? qsTr("Reinstall") : qsTr("Install")
@@ -63,6 +63,207 @@ Item {
             Item { Layout.fillWidth: true }
         }
 
+        ProgressBar {
+            Layout.fillWidth: true
+            from: 0
+            to: 100
+            value: Installer.progress
+            visible: Installer.status == DebInstaller.Installing
+        }
+
+        // dpkg 询问配置文件的处理方式
+        ColumnLayout {
+            Layout.fillWidth: true
+            visible: Installer.conffilePrompt !== ""
+
+            Label {
+                Layout.fillWidth: true
+                text: qsTr("The configuration file %1 has been modified locally and the package ships a new version.")
+                      .arg(Installer.conffilePrompt)
+                wrapMode: Text.Wrap
+            }
+
+            RowLayout {
+                spacing: FishUI.Units.largeSpacing
+
+                Button {
+                    Layout.fillWidth: true
+                    text: qsTr("Keep Current Version")
+                    onClicked: Installer.answerConffile(false)
+                }
+
+                Button {
+                    Layout.fillWidth: true
+                    text: qsTr("Install Package Version")
+                    onClicked: Installer.answerConffile(true)
+                }
+            }
+        }
+
+        // 维护脚本通过 debconf 提出的问题
+        ColumnLayout {
+            id: _debconfForm
+            Layout.fillWidth: true
+            visible: Installer.debconfQuestions.length > 0
+
+            property var answers: ({})
+
+            Repeater {
+                model: Installer.debconfQuestions
+
+                delegate: ColumnLayout {
+                    Layout.fillWidth: true
+
+                    property var question: modelData
+
+                    Label {
+                        Layout.fillWidth: true
+                        text: question.description || question.name
+                        font.bold: true
+                        wrapMode: Text.Wrap
+                    }
+
+                    Label {
+                        Layout.fillWidth: true
+                        text: question.extended_description || ""
+                        color: FishUI.Theme.disabledTextColor
+                        wrapMode: Text.Wrap
+                        visible: text
+                    }
+
+                    CheckBox {
+                        visible: question.type === "boolean"
+                        checked: question.value === "true"
+                        onToggled: _debconfForm.answers[question.name] = checked ? "true" : "false"
+                    }
+
+                    ComboBox {
+                        Layout.fillWidth: true
+                        visible: question.type === "select"
+                        model: question.choices ? question.choices.split(", ") : []
+                        currentIndex: Math.max(0, model.indexOf(question.value))
+                        onActivated: _debconfForm.answers[question.name] = currentText
+                    }
+
+                    TextField {
+                        Layout.fillWidth: true
+                        visible: question.type === "string" || question.type === "password"
+                                 || question.type === "multiselect"
+                        echoMode: question.type === "password" ? TextInput.Password : TextInput.Normal
+                        text: question.value
+                        onTextEdited: _debconfForm.answers[question.name] = text
+                    }
+                }
+            }
+
+            Button {
+                Layout.fillWidth: true
+                text: qsTr("Continue")
+                onClicked: {
+                    Installer.answerDebconf(_debconfForm.answers)
+                    _debconfForm.answers = {}
+                }
+            }
+        }
+
+        Label {
+            Layout.fillWidth: true
+            text: Installer.installSummary
+            color: FishUI.Theme.disabledTextColor
+            wrapMode: Text.Wrap
+            visible: text && Installer.status != DebInstaller.Installing
+        }
+
+        // 各个包各个阶段的耗时，点击表头排序
+        ColumnLayout {
+            id: _timings
+            Layout.fillWidth: true
+            visible: Installer.timings.length > 0 && Installer.status != DebInstaller.Installing
+
+            property string sortKey: "duration"
+            property bool descending: true
+            property var sortedTimings: {
+                var list = Installer.timings.slice()
+                var key = sortKey
+                var order = descending ? -1 : 1
+                list.sort(function(a, b) {
+                    if (a[key] < b[key]) return -order
+                    if (a[key] > b[key]) return order
+                    return 0
+                })
+                return list
+            }
+
+            function phaseName(phase) {
+                switch (phase) {
+                case "unpack": return qsTr("Unpack")
+                case "configure": return qsTr("Configure")
+                case "postinst": return qsTr("Post-install script")
+                case "trigger": return qsTr("Trigger")
+                case "remove": return qsTr("Remove")
+                case "prompt": return qsTr("Waiting for answer")
+                }
+                return qsTr("dpkg")
+            }
+
+            RowLayout {
+                Layout.fillWidth: true
+
+                Repeater {
+                    model: [
+                        { key: "package", title: qsTr("Package") },
+                        { key: "phase", title: qsTr("Phase") },
+                        { key: "duration", title: qsTr("Time") }
+                    ]
+
+                    delegate: Button {
+                        Layout.fillWidth: true
+                        Layout.preferredWidth: 1
+                        flat: true
+                        text: modelData.title + (_timings.sortKey === modelData.key ? (_timings.descending ? " ▼" : " ▲") : "")
+                        onClicked: {
+                            if (_timings.sortKey === modelData.key) {
+                                _timings.descending = !_timings.descending
+                            } else {
+                                _timings.sortKey = modelData.key
+                                _timings.descending = modelData.key === "duration"
+                            }
+                        }
+                    }
+                }
+            }
+
+            ListView {
+                Layout.fillWidth: true
+                Layout.preferredHeight: Math.min(contentHeight, 150)
+                clip: true
+                model: _timings.sortedTimings
+
+                delegate: RowLayout {
+                    width: ListView.view.width
+
+                    Label {
+                        Layout.fillWidth: true
+                        Layout.preferredWidth: 1
+                        text: modelData.package || "-"
+                        elide: Text.ElideRight
+                    }
+
+                    Label {
+                        Layout.fillWidth: true
+                        Layout.preferredWidth: 1
+                        text: _timings.phaseName(modelData.phase)
+                    }
+
+                    Label {
+                        Layout.fillWidth: true
+                        Layout.preferredWidth: 1
+                        text: qsTr("%1 s").arg((modelData.duration / 1000).toFixed(1))
+                    }
+                }
+            }
+        }
+
         Item {
             height: FishUI.Units.largeSpacing
         }
@@ -83,12 +284,24 @@ Item {
             }
         }
 
-        Button {
-            Layout.fillWidth: true
-            flat: true
-            text: qsTr("Quit")
-            enabled: Installer.status == DebInstaller.Succeeded
-            onClicked: Qt.quit()
+        RowLayout {
+            spacing: FishUI.Units.largeSpacing
+
+            Button {
+                Layout.fillWidth: true
+                text: qsTr("Next Package (%1)").arg(Installer.queuedFiles.length)
+                visible: Installer.queuedFiles.length > 0
+                enabled: Installer.status == DebInstaller.Succeeded
+                onClicked: Installer.openNextQueuedFile()
+            }
+
+            Button {
+                Layout.fillWidth: true
+                flat: true
+                text: qsTr("Quit")
+                enabled: Installer.status == DebInstaller.Succeeded
+                onClicked: Qt.quit()
+            }
         }
     }
 }
@@ -53,9 +53,17 @@ FishUI.Window {
         id: _dropArea
         anchors.fill: parent
 
+        // 悬停期间提前解析，放下前后的等待基本消失
+        onEntered: {
+            if (drag.hasUrls)
+                Installer.preview(drag.urls)
+        }
+
+        onExited: Installer.cancelPreview()
+
         onDropped: {
             if (drop.hasUrls)
-                Installer.fileName = drop.urls[0]
+                Installer.addFiles(drop.urls)
         }
     }
 
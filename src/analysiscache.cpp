@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) 2021 Cutefish Technology Co., Ltd.
+ *
+ * Author:     Reion Wong <reion@cutefishos.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "analysiscache.h"
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDir>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSaveFile>
+#include <QStandardPaths>
+
+namespace {
+
+// 路径与目标一起决定缓存文件名，同一个包对不同的根目录有不同的结论
+QString cacheFile(const QString &debFile, const TargetRoot &root)
+{
+    const QByteArray key = QFile::encodeName(debFile) + '\n' + QFile::encodeName(root.adminDir());
+    return QString("%1/analysis/%2.json")
+            .arg(QStandardPaths::writableLocation(QStandardPaths::CacheLocation),
+                 QString::fromLatin1(QCryptographicHash::hash(key, QCryptographicHash::Sha1).toHex()));
+}
+
+// 安装、卸载或 apt update 之后依赖结论可能改变
+qint64 systemStamp(const TargetRoot &root)
+{
+    const QFileInfo status(root.adminDir() + "/status");
+    const QFileInfo lists(root.path("/var/lib/apt/lists"));
+    return qMax(status.lastModified().toMSecsSinceEpoch(), lists.lastModified().toMSecsSinceEpoch());
+}
+
+}
+
+bool AnalysisCache::lookup(const QString &debFile, const TargetRoot &root, Entry &entry)
+{
+    QFile file(cacheFile(debFile, root));
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    const QJsonObject object = QJsonDocument::fromJson(file.readAll()).object();
+    const QFileInfo info(debFile);
+    if (object.value("size").toDouble() != info.size()
+            || object.value("mtime").toDouble() != info.lastModified().toMSecsSinceEpoch()
+            || object.value("system").toDouble() != systemStamp(root)) {
+        return false;
+    }
+
+    entry.package = object.value("package").toString();
+    entry.version = object.value("version").toString();
+    entry.maintainer = object.value("maintainer").toString();
+    entry.description = object.value("description").toString();
+    entry.homePage = object.value("homePage").toString();
+    entry.installedSize = object.value("installedSize").toString();
+    entry.canInstall = object.value("canInstall").toBool();
+    entry.message = object.value("message").toString();
+    for (const QJsonValue &value : object.value("additionalPackages").toArray()) {
+        entry.additionalPackages << value.toString();
+    }
+
+    return !entry.package.isEmpty();
+}
+
+void AnalysisCache::store(const QString &debFile, const TargetRoot &root, const Entry &entry)
+{
+    const QFileInfo info(debFile);
+
+    QJsonObject object;
+    object["file"] = debFile;
+    object["size"] = info.size();
+    object["mtime"] = info.lastModified().toMSecsSinceEpoch();
+    object["system"] = systemStamp(root);
+    object["package"] = entry.package;
+    object["version"] = entry.version;
+    object["maintainer"] = entry.maintainer;
+    object["description"] = entry.description;
+    object["homePage"] = entry.homePage;
+    object["installedSize"] = entry.installedSize;
+    object["canInstall"] = entry.canInstall;
+    object["message"] = entry.message;
+    object["additionalPackages"] = QJsonArray::fromStringList(entry.additionalPackages);
+
+    const QString fileName = cacheFile(debFile, root);
+    QDir().mkpath(QFileInfo(fileName).path());
+
+    QSaveFile file(fileName);
+    if (file.open(QIODevice::WriteOnly)) {
+        file.write(QJsonDocument(object).toJson(QJsonDocument::Compact));
+        file.commit();
+    }
+}
@@ -0,0 +1,49 @@
+/*
+ * Copyright (C) 2021 Cutefish Technology Co., Ltd.
+ *
+ * Author:     Reion Wong <reion@cutefishos.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef ANALYSISCACHE_H
+#define ANALYSISCACHE_H
+
+#include <QString>
+#include <QStringList>
+
+#include "targetroot.h"
+
+// 包的分析结果（控制信息与依赖检查结论）保存在缓存目录中，
+// 后台预分析过的包在界面中打开时无需再运行 dpkg 与依赖检查。
+// 包文件的大小、修改时间或 dpkg、APT 的状态变化后结果自动失效
+class AnalysisCache
+{
+public:
+    struct Entry {
+        QString package;
+        QString version;
+        QString maintainer;
+        QString description;
+        QString homePage;
+        QString installedSize;
+        bool canInstall = false;
+        QString message;
+        QStringList additionalPackages;
+    };
+
+    static bool lookup(const QString &debFile, const TargetRoot &root, Entry &entry);
+    static void store(const QString &debFile, const TargetRoot &root, const Entry &entry);
+};
+
+#endif // ANALYSISCACHE_H
@@ -0,0 +1,203 @@
+/*
+ * Copyright (C) 2021 Cutefish Technology Co., Ltd.
+ *
+ * Author:     Reion Wong <reion@cutefishos.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "cliinstaller.h"
+#include "installscheduler.h"
+#include "helperclient.h"
+#include "installedfiles.h"
+#include <QCoreApplication>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTextStream>
+
+#include <cstdio>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+// 在进程内安装时标准错误会被接到 dpkg 的输出管道上，写到启动时复制的描述符才不会绕回管道
+static QTextStream &err()
+{
+    static FILE *file = ::fdopen(::fcntl(STDERR_FILENO, F_DUPFD_CLOEXEC, 3), "w");
+    static QTextStream stream(file ? file : stderr);
+    return stream;
+}
+
+CliInstaller::CliInstaller(bool json, QObject *parent)
+    : QObject(parent)
+    , m_json(json)
+    , m_jobId(0)
+    , m_checkElapsed(0)
+{
+    // 在任何安装开始之前复制标准错误
+    err();
+
+    if (::geteuid() == 0) {
+        m_backend = new InstallScheduler(this);
+    } else {
+        m_backend = new HelperClient(this);
+    }
+
+    // 进度与 dpkg 输出写到标准错误，标准输出只留给报告
+    connect(m_backend, &InstallBackend::waitingForLock, this, [](const QString &description) {
+        err() << description << Qt::endl;
+    });
+    connect(m_backend, &InstallBackend::message, this, [](const QString &text) {
+        err() << text << Qt::endl;
+    });
+    connect(m_backend, &InstallBackend::output, this, [](const QString &text) {
+        err() << text << Qt::flush;
+    });
+    connect(m_backend, &InstallBackend::jobFinished, this, &CliInstaller::onJobFinished);
+}
+
+void CliInstaller::install(const QStringList &files, const QVariantMap &options)
+{
+    m_files = files;
+    m_elapsed.start();
+    m_action = "install";
+    m_profile = options.value("profile", "safe").toString();
+
+    QVariantMap jobOptions = options;
+    if (jobOptions.value("repair").toBool()) {
+        const TargetRoot root = TargetRoot::fromOptions(options);
+        const InstalledFiles::Comparison comparison = files.size() == 1 ? InstalledFiles::compare(files.first(), root)
+                                                                         : InstalledFiles::Comparison();
+
+        if (comparison.state == InstalledFiles::Comparison::Unchanged) {
+            // 不需要 dpkg，也不需要特权
+            m_action = "none";
+            finishLater(true, QString(),
+                        QStringList() << tr("Installed files already match %1, nothing to do").arg(comparison.package));
+            return;
+        }
+
+        if (comparison.state == InstalledFiles::Comparison::Modified) {
+            m_action = "repair";
+        } else {
+            jobOptions.remove("repair");
+        }
+    }
+
+    m_jobId = m_backend->enqueue(files, jobOptions);
+}
+
+void CliInstaller::provision(const QString &manifestFile, const QVariantMap &options)
+{
+    m_elapsed.start();
+    m_action = "provision";
+    m_profile = options.value("profile", "safe").toString();
+    m_manifest = manifestFile;
+
+    QString errorString;
+    if (!ProvisionManifest::load(manifestFile, m_entries, errorString)) {
+        finishLater(false, errorString, QStringList());
+        return;
+    }
+
+    // 已是最新的机器上，重复执行只花费计算校验和的时间
+    ProvisionManifest::check(m_entries, TargetRoot::fromOptions(options));
+    m_checkElapsed = m_elapsed.elapsed();
+
+    QStringList errors;
+    m_files.clear();
+    for (const ProvisionManifest::Entry &entry : m_entries) {
+        if (entry.action == ProvisionManifest::Entry::Error) {
+            errors << entry.errorString;
+        } else if (entry.action == ProvisionManifest::Entry::Install) {
+            m_files << entry.file;
+        }
+    }
+
+    if (!errors.isEmpty()) {
+        m_files.clear();
+        finishLater(false, errors.join("\n"), QStringList());
+        return;
+    }
+
+    if (m_files.isEmpty()) {
+        finishLater(true, QString(),
+                    QStringList() << tr("All %n package(s) already satisfy the manifest", "", m_entries.size()));
+        return;
+    }
+
+    m_jobId = m_backend->enqueue(m_files, options);
+}
+
+void CliInstaller::finishLater(bool success, const QString &errorString, const QStringList &summary)
+{
+    // 没有安装任务时同样在事件循环开始后报告结果并退出
+    QMetaObject::invokeMethod(this, [this, success, errorString, summary]() {
+        onJobFinished(m_jobId, success, errorString, summary, QVariantList());
+    }, Qt::QueuedConnection);
+}
+
+void CliInstaller::onJobFinished(int id, bool success, const QString &errorString, const QStringList &summary,
+                                 const QVariantList &timings)
+{
+    if (id != m_jobId) {
+        return;
+    }
+
+    if (m_json) {
+        QJsonObject report;
+        report["files"] = QJsonArray::fromStringList(m_files);
+        report["action"] = m_action;
+        report["profile"] = m_profile;
+        report["success"] = success;
+        report["error"] = errorString;
+        report["summary"] = QJsonArray::fromStringList(summary);
+        report["elapsed"] = m_elapsed.elapsed();
+        report["timings"] = QJsonArray::fromVariantList(timings);
+
+        if (!m_manifest.isEmpty()) {
+            QJsonArray packages;
+            for (const ProvisionManifest::Entry &entry : m_entries) {
+                QJsonObject package;
+                package["file"] = entry.file;
+                package["package"] = entry.package;
+                package["version"] = entry.version;
+                package["minVersion"] = entry.minVersion;
+                package["installedVersion"] = entry.installedVersion;
+                package["action"] = ProvisionManifest::actionName(entry.action);
+                package["error"] = entry.errorString;
+                packages << package;
+            }
+            report["manifest"] = m_manifest;
+            report["packages"] = packages;
+            report["checkElapsed"] = m_checkElapsed;
+        }
+
+        QTextStream(stdout) << QJsonDocument(report).toJson();
+    } else {
+        for (const ProvisionManifest::Entry &entry : m_entries) {
+            if (entry.action == ProvisionManifest::Entry::Skip) {
+                err() << tr("%1 %2 is already installed, skipping").arg(entry.package, entry.installedVersion) << Qt::endl;
+            }
+        }
+        for (const QString &line : summary) {
+            err() << line << Qt::endl;
+        }
+        if (!success) {
+            err() << errorString << Qt::endl;
+        }
+    }
+
+    QCoreApplication::exit(success ? 0 : 1);
+}
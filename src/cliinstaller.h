@@ -0,0 +1,68 @@
+/*
+ * Copyright (C) 2021 Cutefish Technology Co., Ltd.
+ *
+ * Author:     Reion Wong <reion@cutefishos.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef CLIINSTALLER_H
+#define CLIINSTALLER_H
+
+#include <QObject>
+#include <QStringList>
+#include <QVariantMap>
+#include <QElapsedTimer>
+
+#include "provisionmanifest.h"
+
+class InstallBackend;
+
+// 不显示窗口的命令行安装，--json 时在标准输出打印机器可读的报告
+class CliInstaller : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit CliInstaller(bool json, QObject *parent = nullptr);
+
+    // 安装结束后以相应的退出码退出事件循环。
+    // options 中 repair 为 true 且已安装同一版本时，只恢复被改动的文件或什么都不做
+    void install(const QStringList &files, const QVariantMap &options);
+
+    // 按清单校验所有包，只把未满足要求的包作为一批安装；任何一个包校验失败时都不安装
+    void provision(const QString &manifestFile, const QVariantMap &options);
+
+private slots:
+    void onJobFinished(int id, bool success, const QString &errorString, const QStringList &summary,
+                       const QVariantList &timings);
+
+private:
+    void finishLater(bool success, const QString &errorString, const QStringList &summary);
+
+private:
+    InstallBackend *m_backend;
+    bool m_json;
+
+    int m_jobId;
+    QStringList m_files;
+    QString m_action;
+    QString m_profile;
+    QElapsedTimer m_elapsed;
+
+    QString m_manifest;
+    QList<ProvisionManifest::Entry> m_entries;
+    qint64 m_checkElapsed;
+};
+
+#endif // CLIINSTALLER_H
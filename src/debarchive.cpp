@@ -0,0 +1,439 @@
+/*
+ * Copyright (C) 2021 Cutefish Technology Co., Ltd.
+ *
+ * Author:     Reion Wong <reion@cutefishos.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "debarchive.h"
+#include "rootedpath.h"
+
+#include <apt-pkg/debfile.h>
+#include <apt-pkg/dirstream.h>
+#include <apt-pkg/error.h>
+#include <apt-pkg/fileutl.h>
+
+#include <QFile>
+
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+const char ArMagic[] = "!<arch>\n";
+const int ArMagicSize = 8;
+
+// ar 成员头：名称 16、修改时间 12、uid 6、gid 6、模式 8、大小 10、结束标记 2
+const int ArHeaderSize = 60;
+
+// 正常的包只有 debian-binary、control.tar、data.tar 三个成员，另留几个给签名等附加成员
+const int MaximumMembers = 8;
+
+bool parseArHeader(const char *header, QByteArray &name, qint64 &size)
+{
+    if (header[58] != '`' || header[59] != '\n') {
+        return false;
+    }
+
+    bool ok = false;
+    name = QByteArray(header, 16).trimmed();
+    size = QByteArray(header + 48, 10).trimmed().toLongLong(&ok);
+    return ok && size >= 0;
+}
+
+// tar 中的路径形如 "./usr/bin/foo"
+QString normalizePath(const char *name)
+{
+    QString path = QString::fromUtf8(name);
+    if (path.startsWith("./")) {
+        path.remove(0, 1);
+    } else if (!path.startsWith('/')) {
+        path.prepend('/');
+    }
+    return path;
+}
+
+class EntryStream : public pkgDirStream
+{
+public:
+    explicit EntryStream(const std::function<bool(const DebArchive::Entry &)> &callback)
+        : m_callback(callback)
+    {
+    }
+
+    bool DoItem(Item &item, int &fd) override
+    {
+        // 只读取头部，跳过文件内容
+        fd = -1;
+
+        stopped = !m_callback({ normalizePath(item.Name), item.Type == Item::Directory, qint64(item.Size) });
+        return !stopped;
+    }
+
+    bool stopped = false;
+
+private:
+    const std::function<bool(const DebArchive::Entry &)> &m_callback;
+};
+
+class MemberStream : public pkgDirStream
+{
+public:
+    explicit MemberStream(const QString &member)
+        : m_member("/" + member)
+    {
+    }
+
+    bool DoItem(Item &item, int &fd) override
+    {
+        if (normalizePath(item.Name) == m_member) {
+            found = true;
+            data.reserve(item.Size);
+            fd = -2;
+        } else {
+            fd = -1;
+        }
+        return true;
+    }
+
+    bool Process(Item &, const unsigned char *buffer, unsigned long long size, unsigned long long) override
+    {
+        data.append(reinterpret_cast<const char *>(buffer), size);
+        return true;
+    }
+
+    bool found = false;
+    QByteArray data;
+
+private:
+    QString m_member;
+};
+
+class ExtractStream : public pkgDirStream
+{
+public:
+    ExtractStream(const QSet<QString> &paths, const QString &rootDir, bool sync)
+        : m_paths(paths)
+        , m_rootDir(rootDir)
+        , m_sync(sync)
+        , m_rootFd(::open(QFile::encodeName(rootDir.isEmpty() ? QString("/") : rootDir).constData(),
+                          O_PATH | O_DIRECTORY | O_CLOEXEC))
+        , m_parentFd(-1)
+    {
+    }
+
+    ~ExtractStream()
+    {
+        closeParent();
+        if (m_rootFd >= 0) {
+            ::close(m_rootFd);
+        }
+    }
+
+    bool DoItem(Item &item, int &fd) override
+    {
+        fd = -1;
+
+        const QString path = normalizePath(item.Name);
+        if (item.Type != Item::File || !m_paths.contains(path)) {
+            return true;
+        }
+
+        m_parentFd = openParent(path);
+        if (m_parentFd < 0) {
+            return _error->Errno("openat2", "Failed to open the directory of %s", item.Name);
+        }
+
+        // 先写入同目录下的临时文件，完成后再替换
+        m_name = QFile::encodeName(path.section('/', -1));
+        m_tempName = m_name + ".dpkg-repair";
+        fd = ::openat(m_parentFd, m_tempName.constData(), O_WRONLY | O_CREAT | O_TRUNC | O_NOFOLLOW | O_CLOEXEC, 0600);
+        if (fd < 0) {
+            closeParent();
+            return _error->Errno("open", "Failed to create %s.dpkg-repair", item.Name);
+        }
+        return true;
+    }
+
+    bool FinishedFile(Item &item, int fd) override
+    {
+        if (fd < 0) {
+            return true;
+        }
+
+        const QString path = normalizePath(item.Name);
+        const struct timespec times[2] = { { time_t(item.MTime), 0 }, { time_t(item.MTime), 0 } };
+
+        // chown 会清除 setuid 位，必须在 chmod 之前
+        bool success = ::fchown(fd, item.UID, item.GID) == 0
+                && ::fchmod(fd, item.Mode & 07777) == 0
+                && ::futimens(fd, times) == 0
+                && (!m_sync || ::fsync(fd) == 0);
+        success = ::close(fd) == 0 && success;
+
+        // 在同一个目录描述符内替换，最后一级是符号链接时替换的是链接本身
+        if (!success || ::renameat(m_parentFd, m_tempName.constData(), m_parentFd, m_name.constData()) != 0) {
+            ::unlinkat(m_parentFd, m_tempName.constData(), 0);
+            closeParent();
+            return _error->Errno("rename", "Failed to restore %s", item.Name);
+        }
+
+        closeParent();
+        extracted << path;
+        return true;
+    }
+
+    bool Fail(Item &, int fd) override
+    {
+        if (fd >= 0) {
+            ::close(fd);
+            ::unlinkat(m_parentFd, m_tempName.constData(), 0);
+        }
+        closeParent();
+        return false;
+    }
+
+    QStringList extracted;
+
+private:
+    // 目标内的符号链接按目标的根目录解析（与 chroot 中相同），写入不会被带到根目录之外
+    int openParent(const QString &path) const
+    {
+        if (m_rootFd < 0) {
+            return -1;
+        }
+
+        const QByteArray parent = QFile::encodeName(path.section('/', 0, -2).mid(1));
+        const char *name = parent.isEmpty() ? "." : parent.constData();
+
+        // 主机上的符号链接本来就在根目录之内，例如 /lib -> usr/lib
+        if (m_rootDir.isEmpty()) {
+            return ::openat(m_rootFd, name, O_PATH | O_DIRECTORY | O_CLOEXEC);
+        }
+
+        return RootedPath::openDirectory(m_rootFd, parent, O_PATH);
+    }
+
+    void closeParent()
+    {
+        if (m_parentFd >= 0) {
+            ::close(m_parentFd);
+            m_parentFd = -1;
+        }
+    }
+
+    const QSet<QString> &m_paths;
+    const QString m_rootDir;
+    const bool m_sync;
+    const int m_rootFd;
+    int m_parentFd;
+    QByteArray m_name;
+    QByteArray m_tempName;
+};
+
+class VerifyStream : public pkgDirStream
+{
+public:
+    explicit VerifyStream(const std::atomic<bool> *cancelled)
+        : m_cancelled(cancelled)
+    {
+    }
+
+    bool DoItem(Item &, int &fd) override
+    {
+        // 读取并丢弃文件内容，解压错误会使 ExtractArchive 失败
+        fd = -2;
+        return !isCancelled();
+    }
+
+    bool Process(Item &, const unsigned char *, unsigned long long, unsigned long long) override
+    {
+        return !isCancelled();
+    }
+
+private:
+    bool isCancelled() const
+    {
+        return m_cancelled && m_cancelled->load();
+    }
+
+    const std::atomic<bool> *m_cancelled;
+};
+
+}
+
+DebArchive::Validity DebArchive::validate(const QString &debFile)
+{
+    int fd = ::open(QFile::encodeName(debFile).constData(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return NotPackage;
+    }
+
+    struct stat st;
+    if (::fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        ::close(fd);
+        return NotPackage;
+    }
+
+    // 魔数、debian-binary 的成员头与其内容 "2.0\n"
+    char head[ArMagicSize + ArHeaderSize + 4];
+    const ssize_t headSize = ::pread(fd, head, sizeof(head), 0);
+    if (headSize < ArMagicSize || ::memcmp(head, ArMagic, ArMagicSize) != 0) {
+        ::close(fd);
+        return NotPackage;
+    }
+    if (headSize < ssize_t(sizeof(head))) {
+        ::close(fd);
+        return Truncated;
+    }
+
+    QByteArray name;
+    qint64 size = 0;
+    if (!parseArHeader(head + ArMagicSize, name, size) || !name.startsWith("debian-binary")
+            || head[ArMagicSize + ArHeaderSize] != '2' || head[ArMagicSize + ArHeaderSize + 1] != '.') {
+        ::close(fd);
+        return NotPackage;
+    }
+
+    // 依次跳过各成员，只读取头部；成员按偶数字节对齐
+    bool hasControl = false;
+    bool hasData = false;
+    Validity validity = Valid;
+    qint64 pos = ArMagicSize;
+
+    for (int i = 0; i < MaximumMembers && pos < st.st_size; ++i) {
+        char header[ArHeaderSize];
+        if (::pread(fd, header, ArHeaderSize, pos) != ArHeaderSize) {
+            validity = Truncated;
+            break;
+        }
+        if (!parseArHeader(header, name, size)) {
+            validity = NotPackage;
+            break;
+        }
+
+        const qint64 end = pos + ArHeaderSize + size;
+        if (end > st.st_size) {
+            validity = Truncated;
+            break;
+        }
+
+        hasControl = hasControl || name.startsWith("control.tar");
+        hasData = hasData || name.startsWith("data.tar");
+        pos = end + (end & 1);
+    }
+
+    ::close(fd);
+
+    if (validity == Valid && (!hasControl || !hasData)) {
+        validity = Truncated;
+    }
+    return validity;
+}
+
+bool DebArchive::readEntries(const QString &debFile, const std::function<bool(const Entry &)> &callback)
+{
+    FileFd fd(debFile.toStdString(), FileFd::ReadOnly);
+    debDebFile deb(fd);
+    EntryStream stream(callback);
+
+    if (_error->PendingError() || !deb.ExtractArchive(stream)) {
+        // 调用方主动停止时 ExtractArchive 同样返回 false
+        _error->Discard();
+        return stream.stopped;
+    }
+
+    return true;
+}
+
+QStringList DebArchive::files(const QString &debFile, bool *ok)
+{
+    QStringList files;
+    bool success = readEntries(debFile, [&files](const Entry &entry) {
+        if (!entry.isDirectory) {
+            files << entry.path;
+        }
+        return true;
+    });
+
+    if (ok) {
+        *ok = success;
+    }
+
+    return success ? files : QStringList();
+}
+
+QByteArray DebArchive::controlMember(const QString &debFile, const QString &member, bool *ok)
+{
+    FileFd fd(debFile.toStdString(), FileFd::ReadOnly);
+    debDebFile deb(fd);
+    MemberStream stream(member);
+
+    bool success = !_error->PendingError() && deb.ExtractTarMember(stream, "control.tar") && stream.found;
+    if (!success) {
+        // _error 是线程局部的，留下的错误会让这个线程之后的所有调用失败
+        _error->Discard();
+    }
+    if (ok) {
+        *ok = success;
+    }
+
+    return success ? stream.data : QByteArray();
+}
+
+QString DebArchive::controlField(const QByteArray &control, const QByteArray &name)
+{
+    for (const QByteArray &line : control.split('\n')) {
+        if (line.startsWith(name + ":")) {
+            return QString::fromUtf8(line.mid(name.size() + 1).trimmed());
+        }
+    }
+    return QString();
+}
+
+bool DebArchive::verifyData(const QString &debFile, const std::atomic<bool> *cancelled)
+{
+    FileFd fd(debFile.toStdString(), FileFd::ReadOnly);
+    debDebFile deb(fd);
+    VerifyStream stream(cancelled);
+
+    bool success = !_error->PendingError() && deb.ExtractArchive(stream);
+    if (!success) {
+        _error->Discard();
+    }
+
+    return success && !(cancelled && cancelled->load());
+}
+
+bool DebArchive::extractFiles(const QString &debFile, const QSet<QString> &paths, QStringList *extracted,
+                              const QString &rootDir, bool sync)
+{
+    FileFd fd(debFile.toStdString(), FileFd::ReadOnly);
+    debDebFile deb(fd);
+    ExtractStream stream(paths, rootDir, sync);
+
+    bool success = !_error->PendingError() && deb.ExtractArchive(stream);
+    if (!success) {
+        _error->Discard();
+    }
+    if (extracted) {
+        *extracted = stream.extracted;
+    }
+
+    return success;
+}
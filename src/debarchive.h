@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) 2021 Cutefish Technology Co., Ltd.
+ *
+ * Author:     Reion Wong <reion@cutefishos.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef DEBARCHIVE_H
+#define DEBARCHIVE_H
+
+#include <QString>
+#include <QStringList>
+#include <QByteArray>
+#include <QSet>
+
+#include <atomic>
+#include <functional>
+
+// 基于 apt-pkg 的 ar/tar 读取，不需要启动 dpkg-deb
+class DebArchive
+{
+public:
+    enum Validity {
+        Valid,
+        NotPackage,  // 不是 ar 归档，或第一个成员不是 debian-binary
+        Truncated,   // 成员超出文件末尾或缺少 data.tar，通常是下载未完成
+    };
+
+    struct Entry {
+        QString path;      // 以 / 开头
+        bool isDirectory;
+        qint64 size;
+    };
+
+    // 只读取前 72 字节与之后每个成员的 60 字节头部，检查 ar 结构与成员大小，不解压任何内容
+    static Validity validate(const QString &debFile);
+
+    // 逐条读取 data.tar 的头部而不读取文件内容，callback 返回 false 时停止读取；
+    // 只有读取出错时返回 false
+    static bool readEntries(const QString &debFile, const std::function<bool(const Entry &)> &callback);
+
+    // data.tar 中的文件路径（以 / 开头，不含目录）
+    static QStringList files(const QString &debFile, bool *ok = nullptr);
+
+    // control.tar 中指定成员的内容，例如 "md5sums"、"triggers"
+    static QByteArray controlMember(const QString &debFile, const QString &member, bool *ok = nullptr);
+
+    // control 文件中单行字段的值，例如 "Package"、"Version"
+    static QString controlField(const QByteArray &control, const QByteArray &name);
+
+    // 完整解压 data.tar 以检查包是否损坏，cancelled 置位时提前返回 false
+    static bool verifyData(const QString &debFile, const std::atomic<bool> *cancelled = nullptr);
+
+    // 把 data.tar 中指定的普通文件原子地写回 rootDir 下，保留权限、属主与修改时间；
+    // sync 为 false 时替换前不调用 fsync
+    static bool extractFiles(const QString &debFile, const QSet<QString> &paths, QStringList *extracted = nullptr,
+                             const QString &rootDir = QString(), bool sync = true);
+};
+
+#endif // DEBARCHIVE_H
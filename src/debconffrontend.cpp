@@ -0,0 +1,248 @@
+/*
+ * Copyright (C) 2021 Cutefish Technology Co., Ltd.
+ *
+ * Author:     Reion Wong <reion@cutefishos.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "debconffrontend.h"
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QDir>
+#include <QTemporaryDir>
+#include <QTimer>
+#include <QDebug>
+
+// 等待界面回答的最长时间，超时后使用默认值
+static const int AnswerTimeout = 10 * 60 * 1000;
+
+DebconfFrontend::DebconfFrontend(QObject *parent)
+    : QObject(parent)
+    , m_server(new QLocalServer(this))
+    , m_socket(nullptr)
+    , m_socketDir(nullptr)
+    , m_answerTimer(new QTimer(this))
+    , m_interactive(false)
+    , m_waitingForAnswer(false)
+{
+    m_server->setSocketOptions(QLocalServer::UserAccessOption);
+    connect(m_server, &QLocalServer::newConnection, this, &DebconfFrontend::onNewConnection);
+
+    m_answerTimer->setSingleShot(true);
+    m_answerTimer->setInterval(AnswerTimeout);
+    connect(m_answerTimer, &QTimer::timeout, this, &DebconfFrontend::onAnswerTimeout);
+}
+
+DebconfFrontend::~DebconfFrontend()
+{
+    m_server->close();
+    delete m_socketDir;
+}
+
+bool DebconfFrontend::listen()
+{
+    if (m_server->isListening()) {
+        return true;
+    }
+
+    // 套接字放在随机命名、权限为 0700 的目录中，其他用户无法预先占用或连接
+    if (!m_socketDir) {
+        QString base = qEnvironmentVariable("XDG_RUNTIME_DIR");
+        if (base.isEmpty()) {
+            base = QDir::tempPath();
+        }
+
+        m_socketDir = new QTemporaryDir(base + "/cutefish-debinstaller-XXXXXX");
+        if (!m_socketDir->isValid()) {
+            qWarning() << "Failed to create debconf socket directory" << m_socketDir->errorString();
+            delete m_socketDir;
+            m_socketDir = nullptr;
+            return false;
+        }
+    }
+
+    const QString path = m_socketDir->filePath("debconf");
+    if (!m_server->listen(path)) {
+        qWarning() << "Failed to listen on" << path << m_server->errorString();
+        return false;
+    }
+
+    m_socketPath = m_server->fullServerName();
+    return true;
+}
+
+QString DebconfFrontend::socketPath() const
+{
+    return m_socketPath;
+}
+
+void DebconfFrontend::setInteractive(bool interactive)
+{
+    m_interactive = interactive;
+}
+
+void DebconfFrontend::answer(const QVariantMap &values)
+{
+    if (!m_waitingForAnswer) {
+        return;
+    }
+
+    for (auto it = values.constBegin(); it != values.constEnd(); ++it) {
+        m_values.insert(it.key(), it.value().toString());
+    }
+
+    m_answerTimer->stop();
+    m_waitingForAnswer = false;
+    m_pendingQuestions.clear();
+    reply("0 ok");
+
+    // 等待期间缓存的后续命令
+    processBuffer();
+}
+
+void DebconfFrontend::onNewConnection()
+{
+    // 同一时间只回答一个维护脚本，其余连接排队，当前脚本断开后依次处理
+    while (QLocalSocket *socket = m_server->nextPendingConnection()) {
+        m_queuedSockets << socket;
+        connect(socket, &QLocalSocket::disconnected, this, [this, socket]() {
+            if (m_queuedSockets.removeOne(socket)) {
+                socket->deleteLater();
+            }
+        });
+    }
+
+    if (!m_socket) {
+        takeNextSocket();
+    }
+}
+
+void DebconfFrontend::takeNextSocket()
+{
+    while (!m_socket && !m_queuedSockets.isEmpty()) {
+        QLocalSocket *socket = m_queuedSockets.takeFirst();
+        disconnect(socket, &QLocalSocket::disconnected, this, nullptr);
+
+        // 排队期间已经断开的连接不再处理
+        if (socket->state() != QLocalSocket::ConnectedState) {
+            socket->deleteLater();
+            continue;
+        }
+
+        m_socket = socket;
+        m_buffer.clear();
+        connect(m_socket, &QLocalSocket::readyRead, this, &DebconfFrontend::onReadyRead);
+        connect(m_socket, &QLocalSocket::disconnected, this, &DebconfFrontend::onDisconnected);
+
+        // 排队期间收到的命令
+        if (m_socket->bytesAvailable() > 0) {
+            onReadyRead();
+        }
+    }
+}
+
+void DebconfFrontend::onReadyRead()
+{
+    m_buffer.append(m_socket->readAll());
+    processBuffer();
+}
+
+void DebconfFrontend::onDisconnected()
+{
+    m_socket->deleteLater();
+    m_socket = nullptr;
+    m_answerTimer->stop();
+    m_waitingForAnswer = false;
+    m_pendingQuestions.clear();
+
+    // SET 的值与问题描述保留给之后的维护脚本：postinst 会读取 config 脚本设置的值。
+    // 问题名称以包名开头，不同的包之间不会混淆。
+    // STOP 时在处理命令的过程中断开，下一个连接等回到事件循环后再接手
+    QMetaObject::invokeMethod(this, &DebconfFrontend::takeNextSocket, Qt::QueuedConnection);
+}
+
+void DebconfFrontend::onAnswerTimeout()
+{
+    qWarning() << "No answer to debconf questions, using defaults for" << m_pendingQuestions;
+    answer(QVariantMap());
+}
+
+void DebconfFrontend::processBuffer()
+{
+    int pos;
+    while (!m_waitingForAnswer && (pos = m_buffer.indexOf('\n')) >= 0) {
+        QString line = QString::fromUtf8(m_buffer.left(pos));
+        m_buffer.remove(0, pos + 1);
+        handleCommand(line);
+    }
+}
+
+void DebconfFrontend::handleCommand(const QString &line)
+{
+    const QString command = line.section(' ', 0, 0);
+
+    if (command == "DATA") {
+        // DATA <问题> <字段> <值>，描述中的换行被转义为 \n
+        const QString tag = line.section(' ', 1, 1);
+        const QString key = line.section(' ', 2, 2);
+        QString value = line.section(' ', 3);
+        value.replace("\\n", "\n");
+        m_data[tag].insert(key, value);
+        reply("0 ok");
+    } else if (command == "SET") {
+        m_values.insert(line.section(' ', 1, 1), line.section(' ', 2));
+        reply("0 ok");
+    } else if (command == "GET") {
+        reply("0 " + m_values.value(line.section(' ', 1, 1)));
+    } else if (command == "INPUT") {
+        m_pendingQuestions << line.section(' ', 2, 2);
+        reply("0 ok");
+    } else if (command == "TITLE") {
+        m_title = line.section(' ', 1);
+        reply("0 ok");
+    } else if (command == "GO") {
+        // 非交互模式直接使用 debconf 提供的预置值
+        if (!m_interactive || m_pendingQuestions.isEmpty()) {
+            m_pendingQuestions.clear();
+            reply("0 ok");
+            return;
+        }
+
+        QVariantList questions;
+        for (const QString &tag : m_pendingQuestions) {
+            QVariantMap question = m_data.value(tag);
+            question.insert("name", tag);
+            question.insert("title", m_title);
+            question.insert("value", m_values.value(tag));
+            questions << question;
+        }
+
+        m_waitingForAnswer = true;
+        m_answerTimer->start();
+        emit questionsReady(questions);
+    } else if (command == "STOP") {
+        m_socket->disconnectFromServer();
+    } else {
+        // CAPB、PROGRESS、INFO、X_PING 等不需要处理
+        reply("0 ok");
+    }
+}
+
+void DebconfFrontend::reply(const QString &text)
+{
+    if (m_socket) {
+        m_socket->write(text.toUtf8() + "\n");
+        m_socket->flush();
+    }
+}
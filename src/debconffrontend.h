@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2021 Cutefish Technology Co., Ltd.
+ *
+ * Author:     Reion Wong <reion@cutefishos.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef DEBCONFFRONTEND_H
+#define DEBCONFFRONTEND_H
+
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QHash>
+#include <QList>
+#include <QVariantMap>
+#include <QVariantList>
+
+#include <atomic>
+
+class QLocalServer;
+class QLocalSocket;
+class QTemporaryDir;
+class QTimer;
+
+// debconf passthrough 前端：维护脚本通过 DEBCONF_PIPE 连接到这里提问，
+// 非交互模式下直接使用预置的默认值回答，交互模式下把问题交给界面；
+// 界面在限定时间内没有回答时同样使用默认值，维护脚本不会一直持有 dpkg 锁
+class DebconfFrontend : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit DebconfFrontend(QObject *parent = nullptr);
+    ~DebconfFrontend();
+
+    bool listen();
+    QString socketPath() const;
+
+    // 可在执行安装的工作线程中调用
+    void setInteractive(bool interactive);
+
+    // 界面回答问题后调用，键为问题名称；values 为空时使用默认值
+    void answer(const QVariantMap &values);
+
+signals:
+    void questionsReady(const QVariantList &questions);
+
+private slots:
+    void onNewConnection();
+    void onReadyRead();
+    void onDisconnected();
+    void onAnswerTimeout();
+
+private:
+    void takeNextSocket();
+    void processBuffer();
+    void handleCommand(const QString &line);
+    void reply(const QString &text);
+
+private:
+    QLocalServer *m_server;
+    QLocalSocket *m_socket;
+    QList<QLocalSocket *> m_queuedSockets;
+    QTemporaryDir *m_socketDir;
+    QTimer *m_answerTimer;
+    QString m_socketPath;
+    QByteArray m_buffer;
+
+    std::atomic<bool> m_interactive;
+    bool m_waitingForAnswer;
+
+    QString m_title;
+    QHash<QString, QVariantMap> m_data;
+    QHash<QString, QString> m_values;
+    QStringList m_pendingQuestions;
+};
+
+#endif // DEBCONFFRONTEND_H
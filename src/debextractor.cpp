@@ -0,0 +1,558 @@
+/*
+ * Copyright (C) 2021 Cutefish Technology Co., Ltd.
+ *
+ * Author:     Reion Wong <reion@cutefishos.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "debextractor.h"
+#include "installedfiles.h"
+#include "rootedpath.h"
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QMutex>
+#include <QScopeGuard>
+#include <QThread>
+#include <QWaitCondition>
+
+#include <apt-pkg/debfile.h>
+#include <apt-pkg/dirstream.h>
+#include <apt-pkg/error.h>
+#include <apt-pkg/fileutl.h>
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <vector>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <unistd.h>
+
+namespace {
+
+// 小于此大小的文件整个读入内存交给写入线程，更大的由读取线程直接写入
+const qint64 PooledFileLimit = 4 * 1024 * 1024;
+
+// 等待写入的数据超过此大小或文件数超过此数量时读取线程暂停，内存与打开的目录描述符不随包的大小增长
+const qint64 MaximumQueuedBytes = 64 * 1024 * 1024;
+const int MaximumQueuedFiles = 256;
+
+// path 相对于目标目录，例如 "usr/bin/foo"
+struct Metadata {
+    QByteArray path;
+    mode_t mode;
+    uid_t uid;
+    gid_t gid;
+    time_t mtime;
+};
+
+// 在目标目录内解析出的父目录，同一目录下连续的文件共用
+struct ParentDirectory {
+    explicit ParentDirectory(int fd) : fd(fd) {}
+    ~ParentDirectory() { ::close(fd); }
+    const int fd;
+};
+
+struct FileTask {
+    Metadata metadata;
+    std::shared_ptr<const ParentDirectory> parent;
+    QByteArray name;
+    QByteArray data;
+};
+
+QString takeAptErrors()
+{
+    QStringList messages;
+    std::string message;
+    while (!_error->empty()) {
+        if (_error->PopMessage(message)) {
+            messages << QString::fromStdString(message);
+        }
+    }
+    return messages.join('\n');
+}
+
+// tar 中的路径形如 "./usr/bin/foo"；包含 ".." 的路径会写到目标目录之外，返回空字符串
+QString safePath(const char *name)
+{
+    QString path = QString::fromUtf8(name);
+    if (path.startsWith("./")) {
+        path.remove(0, 1);
+    } else if (!path.startsWith('/')) {
+        path.prepend('/');
+    }
+
+    if (path.split('/').contains("..")) {
+        return QString();
+    }
+
+    while (path.size() > 1 && path.endsWith('/')) {
+        path.chop(1);
+    }
+    return path;
+}
+
+QByteArray baseName(const QByteArray &path)
+{
+    return path.mid(path.lastIndexOf('/') + 1);
+}
+
+QByteArray parentPath(const QByteArray &path)
+{
+    const int slash = path.lastIndexOf('/');
+    return slash < 0 ? QByteArray() : path.left(slash);
+}
+
+bool applyMetadata(int fd, const Metadata &metadata, bool restoreOwner)
+{
+    const struct timespec times[2] = { { metadata.mtime, 0 }, { metadata.mtime, 0 } };
+
+    // chown 会清除 setuid 位，必须在 chmod 之前
+    return (!restoreOwner || ::fchown(fd, metadata.uid, metadata.gid) == 0)
+            && ::fchmod(fd, metadata.mode & 07777) == 0
+            && ::futimens(fd, times) == 0;
+}
+
+// 用于符号链接与设备文件，name 是 dirFd 下刚创建的文件
+bool applyPathMetadata(int dirFd, const QByteArray &name, const Metadata &metadata, bool isSymlink, bool restoreOwner)
+{
+    const struct timespec times[2] = { { metadata.mtime, 0 }, { metadata.mtime, 0 } };
+
+    if (restoreOwner && ::fchownat(dirFd, name.constData(), metadata.uid, metadata.gid, AT_SYMLINK_NOFOLLOW) != 0) {
+        return false;
+    }
+
+    // 符号链接本身没有权限位
+    if (!isSymlink && ::fchmodat(dirFd, name.constData(), metadata.mode & 07777, 0) != 0) {
+        return false;
+    }
+
+    return ::utimensat(dirFd, name.constData(), times, AT_SYMLINK_NOFOLLOW) == 0;
+}
+
+bool writeFile(const FileTask &task, bool restoreOwner)
+{
+    int fd = ::openat(task.parent->fd, task.name.constData(), O_WRONLY | O_CREAT | O_TRUNC | O_NOFOLLOW | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        return false;
+    }
+
+    const char *data = task.data.constData();
+    qint64 remaining = task.data.size();
+    while (remaining > 0) {
+        const ssize_t written = ::write(fd, data, remaining);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            ::close(fd);
+            return false;
+        }
+        data += written;
+        remaining -= written;
+    }
+
+    // 与 dpkg -x 一样不调用 fsync
+    bool success = applyMetadata(fd, task.metadata, restoreOwner);
+    return ::close(fd) == 0 && success;
+}
+
+// 写入小文件的线程池，大量小文件时 open、write、chmod 等系统调用可以并行
+class WriterPool
+{
+public:
+    WriterPool(int threads, const QString &destination, bool restoreOwner)
+        : m_destination(destination)
+        , m_restoreOwner(restoreOwner)
+        , m_queuedBytes(0)
+        , m_finishing(false)
+        , m_failed(false)
+    {
+        for (int i = 0; i < threads; ++i) {
+            m_threads.push_back(QThread::create([this]() {
+                run();
+            }));
+            m_threads.back()->start();
+        }
+    }
+
+    ~WriterPool()
+    {
+        finish();
+    }
+
+    void add(FileTask &&task)
+    {
+        QMutexLocker locker(&m_mutex);
+        while ((m_queuedBytes > MaximumQueuedBytes || int(m_tasks.size()) >= MaximumQueuedFiles) && !m_failed) {
+            m_taskTaken.wait(&m_mutex);
+        }
+
+        m_queuedBytes += task.data.size();
+        m_tasks.push_back(std::move(task));
+        m_taskAdded.wakeOne();
+    }
+
+    // 等待队列中的文件全部写完
+    bool finish()
+    {
+        {
+            QMutexLocker locker(&m_mutex);
+            m_finishing = true;
+            m_taskAdded.wakeAll();
+        }
+
+        for (QThread *thread : m_threads) {
+            thread->wait();
+            delete thread;
+        }
+        m_threads.clear();
+
+        return !m_failed;
+    }
+
+    bool failed() const
+    {
+        return m_failed;
+    }
+
+    QString errorString() const
+    {
+        QMutexLocker locker(&m_mutex);
+        return m_errorString;
+    }
+
+private:
+    void run()
+    {
+        while (true) {
+            FileTask task;
+            {
+                QMutexLocker locker(&m_mutex);
+                while (m_tasks.empty() && !m_finishing) {
+                    m_taskAdded.wait(&m_mutex);
+                }
+                if (m_tasks.empty()) {
+                    return;
+                }
+
+                task = std::move(m_tasks.front());
+                m_tasks.pop_front();
+                m_queuedBytes -= task.data.size();
+                m_taskTaken.wakeOne();
+            }
+
+            // 已经失败时只清空队列
+            if (m_failed || writeFile(task, m_restoreOwner)) {
+                continue;
+            }
+
+            const int error = errno;
+            QMutexLocker locker(&m_mutex);
+            if (!m_failed) {
+                m_failed = true;
+                m_errorString = DebExtractor::tr("Failed to write %1: %2")
+                        .arg(m_destination + '/' + QFile::decodeName(task.metadata.path),
+                             QString::fromLocal8Bit(::strerror(error)));
+                m_taskTaken.wakeAll();
+            }
+        }
+    }
+
+    const QString m_destination;
+    const bool m_restoreOwner;
+
+    mutable QMutex m_mutex;
+    QWaitCondition m_taskAdded;
+    QWaitCondition m_taskTaken;
+    std::deque<FileTask> m_tasks;
+    qint64 m_queuedBytes;
+    bool m_finishing;
+    std::atomic<bool> m_failed;
+    QString m_errorString;
+
+    std::vector<QThread *> m_threads;
+};
+
+// 所有路径都在目标目录的描述符下解析，包中的符号链接（例如 ./foo -> /etc 之后再有 ./foo/passwd）
+// 只会指向目标目录之内，文件不会写到或 chown 到目标之外
+class ExtractAllStream : public pkgDirStream
+{
+public:
+    ExtractAllStream(int rootFd, bool hostRoot, WriterPool &pool, bool restoreOwner)
+        : m_rootFd(rootFd)
+        , m_hostRoot(hostRoot)
+        , m_pool(pool)
+        , m_restoreOwner(restoreOwner)
+    {
+    }
+
+    bool DoItem(Item &item, int &fd) override
+    {
+        fd = -1;
+        if (m_pool.failed()) {
+            return false;
+        }
+
+        const QString path = safePath(item.Name);
+        if (path.isEmpty()) {
+            return _error->Error("Refusing to extract %s outside the destination", item.Name);
+        }
+        if (path == "/") {
+            return true;
+        }
+
+        const Metadata metadata = { QFile::encodeName(path.mid(1)), mode_t(item.Mode), uid_t(item.UID),
+                                    gid_t(item.GID), time_t(item.MTime) };
+        const QByteArray name = baseName(metadata.path);
+        const std::shared_ptr<const ParentDirectory> parent = openParent(parentPath(metadata.path));
+        if (!parent) {
+            return _error->Errno("openat2", "Failed to open the directory of %s", item.Name);
+        }
+
+        switch (item.Type) {
+        case Item::Directory:
+            // 先保证可写，权限与时间等目录内容写完后再设置
+            if (::mkdirat(parent->fd, name.constData(), 0700) != 0 && errno != EEXIST) {
+                return _error->Errno("mkdir", "Failed to create %s", item.Name);
+            }
+            directories.push_back(metadata);
+            return true;
+
+        case Item::SymbolicLink:
+            ::unlinkat(parent->fd, name.constData(), 0);
+            if (::symlinkat(item.LinkTarget, parent->fd, name.constData()) != 0
+                    || !applyPathMetadata(parent->fd, name, metadata, true, m_restoreOwner)) {
+                return _error->Errno("symlink", "Failed to create %s", item.Name);
+            }
+            ++files;
+            return true;
+
+        case Item::HardLink: {
+            // 链接目标可能还在写入线程的队列中，全部写完后再创建
+            const QString linkTarget = safePath(item.LinkTarget);
+            if (linkTarget.isEmpty() || linkTarget == "/") {
+                return _error->Error("Refusing to link %s outside the destination", item.Name);
+            }
+            hardLinks.push_back({ metadata.path, QFile::encodeName(linkTarget.mid(1)) });
+            ++files;
+            return true;
+        }
+
+        case Item::CharDevice:
+        case Item::BlockDevice:
+        case Item::FIFO: {
+            const mode_t type = item.Type == Item::CharDevice ? S_IFCHR : item.Type == Item::BlockDevice ? S_IFBLK : S_IFIFO;
+            ::unlinkat(parent->fd, name.constData(), 0);
+            if (::mknodat(parent->fd, name.constData(), type | 0600, makedev(item.Major, item.Minor)) != 0
+                    || !applyPathMetadata(parent->fd, name, metadata, false, m_restoreOwner)) {
+                return _error->Errno("mknod", "Failed to create %s", item.Name);
+            }
+            ++files;
+            return true;
+        }
+
+        case Item::File:
+            ++files;
+            bytes += item.Size;
+
+            if (qint64(item.Size) >= PooledFileLimit) {
+                fd = ::openat(parent->fd, name.constData(), O_WRONLY | O_CREAT | O_TRUNC | O_NOFOLLOW | O_CLOEXEC, 0600);
+                if (fd < 0) {
+                    return _error->Errno("open", "Failed to create %s", item.Name);
+                }
+                m_current = metadata;
+                return true;
+            }
+
+            m_task.metadata = metadata;
+            m_task.parent = parent;
+            m_task.name = name;
+            m_task.data.clear();
+            m_task.data.reserve(item.Size);
+            fd = -2;
+            return true;
+        }
+
+        return true;
+    }
+
+    // 目标目录下的 path，为空时是目标目录本身
+    std::shared_ptr<const ParentDirectory> openParent(const QByteArray &path)
+    {
+        if (m_parent && path == m_parentPath) {
+            return m_parent;
+        }
+
+        // 主机上的符号链接本来就在根目录之内，例如 /lib -> usr/lib
+        const int fd = m_hostRoot ? ::openat(m_rootFd, path.isEmpty() ? "." : path.constData(), O_PATH | O_DIRECTORY | O_CLOEXEC)
+                                  : RootedPath::openDirectory(m_rootFd, path, O_PATH);
+        if (fd < 0) {
+            m_parent.reset();
+            return m_parent;
+        }
+
+        m_parent = std::make_shared<const ParentDirectory>(fd);
+        m_parentPath = path;
+        return m_parent;
+    }
+
+    bool Process(Item &, const unsigned char *buffer, unsigned long long size, unsigned long long) override
+    {
+        m_task.data.append(reinterpret_cast<const char *>(buffer), size);
+        return true;
+    }
+
+    bool FinishedFile(Item &item, int fd) override
+    {
+        if (fd == -2) {
+            m_pool.add(std::move(m_task));
+            m_task = FileTask();
+            return true;
+        }
+
+        if (fd >= 0) {
+            bool success = applyMetadata(fd, m_current, m_restoreOwner);
+            success = ::close(fd) == 0 && success;
+            if (!success) {
+                return _error->Errno("close", "Failed to write %s", item.Name);
+            }
+        }
+        return true;
+    }
+
+    bool Fail(Item &, int fd) override
+    {
+        if (fd >= 0) {
+            ::close(fd);
+        }
+        return false;
+    }
+
+    std::vector<Metadata> directories;
+    // 链接自身与链接目标，均相对于目标目录
+    std::vector<std::pair<QByteArray, QByteArray>> hardLinks;
+    int files = 0;
+    qint64 bytes = 0;
+
+private:
+    const int m_rootFd;
+    const bool m_hostRoot;
+    WriterPool &m_pool;
+    const bool m_restoreOwner;
+
+    QByteArray m_parentPath;
+    std::shared_ptr<const ParentDirectory> m_parent;
+
+    FileTask m_task;
+    Metadata m_current;
+};
+
+}
+
+DebExtractor::Result DebExtractor::extract(const QString &debFile, const QString &destination, int threads)
+{
+    Result result;
+    QElapsedTimer timer;
+    timer.start();
+
+    const QString root = QDir::cleanPath(QDir(destination).absolutePath());
+    if (!QDir().mkpath(root)) {
+        result.errorString = tr("Failed to create %1").arg(root);
+        return result;
+    }
+
+    // 非 root 时与 dpkg -x 一样由当前用户拥有
+    const bool restoreOwner = ::geteuid() == 0;
+    if (threads <= 0) {
+        threads = InstalledFiles::hashThreadCount(root);
+    }
+
+    const int rootFd = ::open(QFile::encodeName(root).constData(), O_PATH | O_DIRECTORY | O_CLOEXEC);
+    if (rootFd < 0) {
+        result.errorString = tr("Failed to open %1: %2").arg(root, QString::fromLocal8Bit(::strerror(errno)));
+        return result;
+    }
+    const auto closeRoot = qScopeGuard([rootFd]() {
+        ::close(rootFd);
+    });
+
+    const QString displayRoot = root == "/" ? QString() : root;
+    WriterPool pool(threads, displayRoot, restoreOwner);
+    ExtractAllStream stream(rootFd, root == "/", pool, restoreOwner);
+
+    FileFd fd(debFile.toStdString(), FileFd::ReadOnly);
+    debDebFile deb(fd);
+
+    // 解压在当前线程进行，与写入线程池流水并行
+    bool success = !_error->PendingError() && deb.ExtractArchive(stream);
+    const bool written = pool.finish();
+
+    if (!written) {
+        _error->Discard();
+        result.errorString = pool.errorString();
+        return result;
+    }
+    if (!success) {
+        result.errorString = takeAptErrors();
+        return result;
+    }
+
+    // 链接与链接目标的目录同样在目标目录内解析；linkat 不跟随链接目标本身的符号链接
+    for (const auto &link : stream.hardLinks) {
+        const std::shared_ptr<const ParentDirectory> targetParent = stream.openParent(parentPath(link.second));
+        const std::shared_ptr<const ParentDirectory> parent = stream.openParent(parentPath(link.first));
+        const QByteArray name = baseName(link.first);
+        if (parent && targetParent) {
+            ::unlinkat(parent->fd, name.constData(), 0);
+        }
+        if (!parent || !targetParent
+                || ::linkat(targetParent->fd, baseName(link.second).constData(), parent->fd, name.constData(), 0) != 0) {
+            result.errorString = tr("Failed to link %1: %2")
+                    .arg(displayRoot + '/' + QFile::decodeName(link.first), QString::fromLocal8Bit(::strerror(errno)));
+            return result;
+        }
+    }
+
+    // 子目录先于父目录设置，父目录的修改时间不会被再次改变。
+    // 已经存在的同名符号链接（例如主机上的 /lib）保持原样，不修改它指向的目录
+    for (auto it = stream.directories.rbegin(); it != stream.directories.rend(); ++it) {
+        const int dirFd = RootedPath::openDirectory(rootFd, it->path, O_RDONLY, false);
+        if (dirFd < 0 && errno == ELOOP) {
+            continue;
+        }
+
+        const bool applied = dirFd >= 0 && applyMetadata(dirFd, *it, restoreOwner);
+        const int error = errno;
+        if (dirFd >= 0) {
+            ::close(dirFd);
+        }
+        if (!applied) {
+            result.errorString = tr("Failed to set attributes of %1: %2")
+                    .arg(displayRoot + '/' + QFile::decodeName(it->path), QString::fromLocal8Bit(::strerror(error)));
+            return result;
+        }
+    }
+
+    result.success = true;
+    result.files = stream.files;
+    result.bytes = stream.bytes;
+    result.elapsed = timer.elapsed();
+    return result;
+}
@@ -0,0 +1,44 @@
+/*
+ * Copyright (C) 2021 Cutefish Technology Co., Ltd.
+ *
+ * Author:     Reion Wong <reion@cutefishos.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef DEBEXTRACTOR_H
+#define DEBEXTRACTOR_H
+
+#include <QString>
+#include <QCoreApplication>
+
+// 不运行维护脚本，只把 data.tar 解压到目录中（相当于 dpkg -x），用于制作容器层和检查包内容。
+// 读取线程解压 data.tar，小文件交给写入线程池并行写盘，大文件由读取线程直接写入
+class DebExtractor
+{
+    Q_DECLARE_TR_FUNCTIONS(DebExtractor)
+
+public:
+    struct Result {
+        bool success = false;
+        QString errorString;
+        int files = 0;       // 写入的普通文件、链接与设备文件
+        qint64 bytes = 0;
+        qint64 elapsed = 0;  // 毫秒
+    };
+
+    // threads 为 0 时按目标所在设备决定写入线程数；以 root 运行时才恢复属主
+    static Result extract(const QString &debFile, const QString &destination, int threads = 0);
+};
+
+#endif // DEBEXTRACTOR_H
@@ -17,43 +17,173 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 #include "debinstaller.h"
+#include "dpkgstatuswatcher.h"
+#include "packagetransaction.h"
+#include "installscheduler.h"
+#include "helperclient.h"
+#include "packageprefetcher.h"
+#include "remotepackage.h"
+#include "analysiscache.h"
+#include "debarchive.h"
 #include <QFileInfo>
-#include <QMimeDatabase>
-#include <QMimeType>
+#include <QProcess>
 #include <QDebug>
 #include <QThread>
-#include <QRegularExpression>
 #include <QFuture>
 #include <QtConcurrent/QtConcurrent>
 
+#include <unistd.h>
+
 DebInstaller::DebInstaller(QObject *parent)
     : QObject(parent)
-    , m_cacheFile(nullptr)
-    , m_installProcess(nullptr)
+    , m_statusWatcher(nullptr)
+    , m_backend(nullptr)
+    , m_jobFailed(false)
     , m_dependencyWatcher(nullptr)
+    , m_prefetcher(new PackagePrefetcher(this))
+    , m_files(new PackageFilesModel(this))
+    , m_remote(new RemotePackage(this))
+    , m_downloadProgress(-1)
+    , m_scanWatcher(new QFutureWatcher<PackageScanner::Result>(this))
+    , m_previewWatcher(new QFutureWatcher<ControlFields>(this))
+    , m_filesCheckWatcher(new QFutureWatcher<InstalledFiles::Comparison>(this))
+    , m_repositoryWatcher(new QFutureWatcher<RepositoryCheck::Result>(this))
+    , m_archiveDamaged(false)
     , m_isValid(false)
     , m_canInstall(false)
     , m_aptInitialized(false)
     , m_isInstalled(false)
     , m_status(DebInstaller::Begin)
+    , m_progress(0)
+    , m_deferTriggers(true)
+    , m_verifyInstall(false)
+    , m_installProfile("safe")
+    , m_conffilePolicy("keep")
 {
+    // 依赖检查与软件源比较在各自的工作线程中打开所需的缓存，这里只初始化配置
     m_aptInitialized = initializeApt();
-    
-    m_installProcess = new QProcess(this);
-    connect(m_installProcess, &QProcess::readyReadStandardOutput, this, &DebInstaller::onInstallOutput);
-    connect(m_installProcess, &QProcess::readyReadStandardError, this, &DebInstaller::onInstallOutput);
-    connect(m_installProcess, &QProcess::finished, this, &DebInstaller::onInstallFinished);
+
+    // 已安装状态直接从 dpkg status 的快照中读取，安装后无需重新打开整个缓存
+    watchStatus();
+
+    // 事务在工作线程中发出信号，经队列连接送回界面线程
+    // root 直接在进程内安装，否则交给通过 D-Bus 激活的特权助手
+    if (::geteuid() == 0) {
+        m_backend = new InstallScheduler(this);
+    } else {
+        m_backend = new HelperClient(this);
+    }
+
+    connect(m_backend, &InstallBackend::jobStarted, this, &DebInstaller::onJobStarted);
+    connect(m_backend, &InstallBackend::jobFinished, this, &DebInstaller::onJobFinished);
+    connect(m_backend, &InstallBackend::waitingForLock, this, [this](const QString &description) {
+        m_statusMessage = description;
+        emit statusMessageChanged();
+    });
+    connect(m_backend, &InstallBackend::message, this, [this](const QString &text) {
+        m_statusDetails += text + "\n";
+        emit statusDetailsTextChanged();
+    });
+    connect(m_backend, &InstallBackend::output, this, [this](const QString &text) {
+        m_statusDetails += text;
+        emit statusDetailsTextChanged();
+    });
+    connect(m_backend, &InstallBackend::progressChanged, this, [this](double percent, const QString &action) {
+        m_progress = percent;
+        m_statusMessage = action;
+        emit progressChanged();
+        emit statusMessageChanged();
+    });
+    connect(m_backend, &InstallBackend::conffilePrompt, this, [this](const QString &conffile) {
+        m_conffilePrompt = conffile;
+        emit conffilePromptChanged();
+    });
+    connect(m_backend, &InstallBackend::debconfQuestions, this, [this](const QVariantList &questions) {
+        m_debconfQuestions = questions;
+        emit debconfQuestionsChanged();
+    });
+
+    connect(m_prefetcher, &PackagePrefetcher::finished, this, &DebInstaller::onPrefetchFinished);
+
+    // 远程包先用占位包显示信息与检查依赖，下载完成后换成完整的文件
+    connect(m_remote, &RemotePackage::controlReady, this, &DebInstaller::openFile);
+    connect(m_remote, &RemotePackage::progressChanged, this, [this](qint64 received, qint64 total) {
+        m_downloadProgress = total > 0 ? double(received) / total : 0;
+        emit downloadProgressChanged();
+    });
+    connect(m_remote, &RemotePackage::finished, this, [this](const QString &localFile) {
+        m_downloadProgress = -1;
+        emit downloadProgressChanged();
+        openFile(localFile);
+    });
+    connect(m_remote, &RemotePackage::failed, this, [this](const QString &errorString) {
+        m_downloadProgress = -1;
+        m_canInstall = false;
+        m_preInstallMessage = tr("Error: %1").arg(errorString);
+        emit downloadProgressChanged();
+        emit canInstallChanged();
+        emit preInstallMessageChanged();
+    });
+
+    connect(m_filesCheckWatcher, &QFutureWatcher<InstalledFiles::Comparison>::finished, this, [this]() {
+        const InstalledFiles::Comparison result = m_filesCheckWatcher->result();
+        if (result.package != m_packageName) {
+            return;
+        }
+
+        if (result.state == InstalledFiles::Comparison::Unchanged) {
+            m_reinstallStatus = tr("The installed files already match this package, nothing to do");
+        } else if (result.state == InstalledFiles::Comparison::Modified) {
+            m_reinstallStatus = tr("%n installed file(s) differ from this package", "", result.changedFiles.size());
+            m_modifiedFiles = result.changedFiles;
+        }
+        emit reinstallStatusChanged();
+    });
+
+    connect(m_repositoryWatcher, &QFutureWatcher<RepositoryCheck::Result>::finished, this, [this]() {
+        if (m_repositoryFile != m_fileName) {
+            return;
+        }
+
+        const RepositoryCheck::Result result = m_repositoryWatcher->result();
+        if (result.state == RepositoryCheck::Result::Matches) {
+            m_repositoryStatus = result.archive.isEmpty() ? tr("Matches repository")
+                                                          : tr("Matches repository (%1)").arg(result.archive);
+        } else if (result.state == RepositoryCheck::Result::Differs) {
+            m_repositoryStatus = tr("Differs from the repository's package of the same version");
+        }
+        emit repositoryStatusChanged();
+    });
+
+    // 放下时还在解析的包，解析完成后再继续打开；等待期间打开了别的包时丢弃
+    connect(m_previewWatcher, &QFutureWatcher<ControlFields>::finished, this, [this]() {
+        if (m_previewOpening.isEmpty() || m_previewOpening != m_fileName) {
+            return;
+        }
+
+        m_previewOpening.clear();
+        finishOpen(previewFields());
+    });
+
+    connect(m_scanWatcher, &QFutureWatcher<PackageScanner::Result>::finished, this, [this]() {
+        const PackageScanner::Result result = m_scanWatcher->result();
+        for (const QString &file : result.skipped) {
+            qInfo() << "Skipping duplicate or older package" << file;
+        }
+        for (const QString &file : result.invalid) {
+            qWarning() << "Ignoring" << file << ": not a Debian package";
+        }
+
+        addFiles(result.files);
+
+        if (!m_scanQueue.isEmpty()) {
+            scanDirectory(m_scanQueue.takeFirst());
+        }
+    });
 }
 
 DebInstaller::~DebInstaller()
 {
-    if (m_cacheFile) {
-        delete m_cacheFile;
-        m_cacheFile = nullptr;
-    }
-    if (m_installProcess) {
-        m_installProcess->deleteLater();
-    }
     if (m_dependencyWatcher) {
         m_dependencyWatcher->deleteLater();
     }
@@ -72,37 +202,74 @@ bool DebInstaller::initializeApt()
         emit statusDetailsTextChanged();
         return false;
     }
-    
-    // 创建缓存文件，它会自动处理系统初始化
-    m_cacheFile = new pkgCacheFile();
-    if (!m_cacheFile->Open(nullptr, true)) {
-        m_statusDetails = tr("Failed to open APT cache");
+
+    // 安装事务需要 _system 来加锁和创建包管理器
+    if (!pkgInitSystem(*_config, _system)) {
+        m_statusDetails = tr("Failed to initialize APT system");
         emit statusDetailsTextChanged();
         return false;
     }
-    
+
     return true;
 }
 
-QString DebInstaller::extractControlField(const QString &fieldName) const
+void DebInstaller::watchStatus()
 {
-    // 使用 dpkg 命令提取控制字段
-    QString output;
-    if (runDpkgCommand(QStringList() << "-I" << m_fileName << fieldName, output)) {
-        // 解析输出，获取字段值
-        QRegularExpression regex(fieldName + ":\\s*(.*)");
-        QRegularExpressionMatch match = regex.match(output);
-        if (match.hasMatch()) {
-            return match.captured(1).trimmed();
+    delete m_statusWatcher;
+    m_statusWatcher = new DpkgStatusWatcher(m_root.adminDir(), this);
+    connect(m_statusWatcher, &DpkgStatusWatcher::packagesChanged, this, &DebInstaller::onPackagesChanged);
+
+    // 快照就绪前打开的包先按未安装显示，就绪后再更新
+    connect(m_statusWatcher, &DpkgStatusWatcher::ready, this, [this]() {
+        if (m_isValid && m_status != Installing) {
+            updatePackageInfo();
+            startInstalledFilesCheck();
         }
+    });
+}
+
+void DebInstaller::onPrefetchFinished(const QString &debFile, bool archiveOk, qint64 elapsed)
+{
+    if (debFile != m_fileName) {
+        return;
     }
-    return QString();
+
+    qInfo() << "Prefetched" << debFile << "in" << elapsed << "ms";
+    if (archiveOk) {
+        return;
+    }
+
+    // 解压 data.tar 失败，dpkg 安装时同样会失败
+    m_archiveDamaged = true;
+    m_canInstall = false;
+    m_preInstallMessage = tr("Error: The package archive is damaged");
+    emit canInstallChanged();
+    emit preInstallMessageChanged();
 }
 
-bool DebInstaller::runDpkgCommand(const QStringList &arguments, QString &output) const
+void DebInstaller::onPackagesChanged(const QStringList &packageNames)
+{
+    // 拖入时开始的依赖检查基于旧的系统状态
+    m_speculativeFile.clear();
+
+    if (!m_isValid || m_status == Installing) {
+        return;
+    }
+
+    if (packageNames.contains(m_packageName)) {
+        updatePackageInfo();
+    }
+
+    // 系统状态变化后依赖结果可能已经过期
+    if (m_status == Begin) {
+        startDependencyCheck();
+    }
+}
+
+bool DebInstaller::runDpkg(const TargetRoot &root, const QStringList &arguments, QString &output)
 {
     QProcess process;
-    process.start("dpkg", arguments);
+    process.start("dpkg", root.dpkgArguments() + arguments);
     if (process.waitForFinished(5000)) {
         output = QString::fromLocal8Bit(process.readAllStandardOutput());
         if (process.exitCode() == 0) {
@@ -112,6 +279,30 @@ bool DebInstaller::runDpkgCommand(const QStringList &arguments, QString &output)
     return false;
 }
 
+DebInstaller::ControlFields DebInstaller::readControlFields(const QString &debFile,
+                                                            const std::atomic<bool> *cancelled)
+{
+    ControlFields fields;
+
+    // 直接从 control.tar 读出 control，不再为每个字段启动 dpkg
+    bool ok = false;
+    const QByteArray control = DebArchive::controlMember(debFile, "control", &ok);
+    if (!ok || (cancelled && cancelled->load())) {
+        return fields;
+    }
+
+    fields.package = DebArchive::controlField(control, "Package");
+    fields.version = DebArchive::controlField(control, "Version");
+    fields.maintainer = DebArchive::controlField(control, "Maintainer");
+    // 只取第一行的简短描述
+    fields.description = DebArchive::controlField(control, "Description");
+    fields.homePage = DebArchive::controlField(control, "Homepage");
+    fields.installedSize = DebArchive::controlField(control, "Installed-Size");
+
+    fields.valid = !fields.package.isEmpty();
+    return fields;
+}
+
 QString DebInstaller::fileName() const
 {
     return m_fileName;
@@ -122,120 +313,470 @@ void DebInstaller::setFileName(const QString &fileName)
     if (fileName.isEmpty() || m_fileName == fileName)
         return;
 
+    // http(s) 地址先只取得控制信息，完整文件在后台下载
+    if (RemotePackage::isRemote(fileName)) {
+        if (m_remote->url() != QUrl(fileName) || !m_remote->isDownloading()) {
+            m_downloadProgress = 0;
+            emit downloadProgressChanged();
+            m_remote->fetch(QUrl(fileName));
+        }
+        return;
+    }
+
+    if (QFileInfo(QString(fileName).remove("file://")).isDir()) {
+        scanDirectory(QFileInfo(QString(fileName).remove("file://")).absoluteFilePath());
+        return;
+    }
+
+    // 打开本地文件时放弃未完成的下载
+    if (m_remote->isDownloading()) {
+        m_remote->cancel();
+        m_downloadProgress = -1;
+        emit downloadProgressChanged();
+    }
+
+    openFile(fileName);
+}
+
+void DebInstaller::openFile(const QString &fileName)
+{
+    if (m_fileName == fileName)
+        return;
+
     QString newPath = fileName;
     newPath = newPath.remove("file://");
 
     QFileInfo info(newPath);
-    QString mimeType = QMimeDatabase().mimeTypeForFile(info.absoluteFilePath()).name();
 
-    if (mimeType != "application/vnd.debian.binary-package") {
-        m_preInstallMessage = tr("Error: Not a valid Debian package");
+    const DebArchive::Validity validity = DebArchive::validate(info.absoluteFilePath());
+    if (validity != DebArchive::Valid) {
+        m_preInstallMessage = validity == DebArchive::Truncated
+                ? tr("Error: The package file is incomplete, the download may not have finished")
+                : tr("Error: Not a valid Debian package");
         emit preInstallMessageChanged();
         return;
     }
 
     m_fileName = info.absoluteFilePath();
+
+    // 拖入的是另一个文件时，推测的结果不再有用
+    if (m_previewFile != m_fileName) {
+        cancelPreview();
+    }
     
     // 重置状态
     m_isValid = false;
     m_canInstall = false;
+    m_archiveDamaged = false;
     m_preInstallMessage.clear();
-    
-    // 解析 deb 文件
-    m_isValid = parseDebFile();
+    m_reinstallStatus.clear();
+    m_modifiedFiles.clear();
+    emit reinstallStatusChanged();
+
+    // 与解析控制信息同时进行，结果稍后单独显示
+    startRepositoryCheck();
+
+    m_previewOpening.clear();
+
+    // 后台预分析过的包直接使用缓存的结论，不再运行 dpkg 与依赖检查
+    AnalysisCache::Entry cached;
+    if (m_queuedFiles.isEmpty() && AnalysisCache::lookup(m_fileName, m_root, cached)) {
+        m_packageName = cached.package;
+        m_version = cached.version;
+        m_maintainer = cached.maintainer;
+        m_description = cached.description;
+        m_homePage = cached.homePage;
+        m_installedSize = cached.installedSize;
+        m_isValid = true;
+        emit isValidChanged();
+
+        updatePackageInfo();
+        m_additionalPackages = cached.additionalPackages;
+        m_canInstall = cached.canInstall && !m_remote->isDownloading();
+        m_preInstallMessage = cached.message;
+        emit canInstallChanged();
+        emit preInstallMessageChanged();
+
+        m_speculativeFile.clear();
+        startFileChecks();
+        emit fileNameChanged();
+        return;
+    }
+
+    // 拖入时已开始解析同一个文件，没有完成时在后台等待，不阻塞界面
+    if (!m_previewFile.isEmpty() && m_previewFile == m_fileName) {
+        m_previewFile.clear();
+        if (!m_previewWatcher->isFinished()) {
+            m_previewOpening = m_fileName;
+            return;
+        }
+
+        finishOpen(previewFields());
+        return;
+    }
+
+    finishOpen(readControlFields(m_fileName));
+}
+
+void DebInstaller::finishOpen(const ControlFields &fields)
+{
+    m_isValid = parseDebFile(fields);
     emit isValidChanged();
-    
+
     if (m_isValid) {
         updatePackageInfo();
-        
-        // 异步检查依赖
-        if (!m_dependencyWatcher) {
-            m_dependencyWatcher = new QFutureWatcher<bool>(this);
-            connect(m_dependencyWatcher, &QFutureWatcher<bool>::finished, [this]() {
-                m_canInstall = m_dependencyWatcher->result();
-                if (!m_canInstall && m_preInstallMessage.isEmpty()) {
-                    m_preInstallMessage = tr("Error: Cannot satisfy dependencies");
-                }
-                emit canInstallChanged();
-                emit preInstallMessageChanged();
-            });
-        }
-        
-        // 使用 QFuture 进行异步操作
-        QFuture<bool> future = QtConcurrent::run([this]() {
-            return checkDependencies() && !checkConflicts() && !checkBreaksSystem();
-        });
-        m_dependencyWatcher->setFuture(future);
+        startDependencyCheck();
+        startFileChecks();
     } else {
+        m_prefetcher->cancel();
         m_preInstallMessage = tr("Error: Invalid or corrupted package");
         emit preInstallMessageChanged();
     }
-    
+
     emit fileNameChanged();
 }
 
-bool DebInstaller::parseDebFile()
+void DebInstaller::startFileChecks()
 {
-    // 使用 dpkg 命令检查包是否有效
-    QString output;
-    if (!runDpkgCommand(QStringList() << "-I" << m_fileName, output)) {
-        return false;
+    startInstalledFilesCheck();
+
+    // 用户查看包信息期间在后台预读，切换文件时自动取消上一次预读
+    m_prefetcher->prefetch(m_fileName);
+    m_files->setFileName(m_fileName);
+}
+
+QStringList DebInstaller::queuedFiles() const
+{
+    return m_queuedFiles;
+}
+
+void DebInstaller::addFiles(const QStringList &files)
+{
+    bool queueChanged = false;
+    QStringList followUp;
+
+    for (const QString &file : files) {
+        // 远程地址直接打开，下载完成前不能加入安装队列
+        if (RemotePackage::isRemote(file)) {
+            if (m_status != Installing) {
+                setFileName(file);
+            }
+            continue;
+        }
+
+        QString path = QFileInfo(QString(file).remove("file://")).absoluteFilePath();
+        if (QFileInfo(path).isDir()) {
+            scanDirectory(path);
+            continue;
+        }
+
+        if (path == m_fileName || m_queuedFiles.contains(path) || m_installingFiles.contains(path))
+            continue;
+
+        // 当前没有打开的包时直接打开，否则加入队列
+        if (m_fileName.isEmpty()) {
+            setFileName(path);
+            continue;
+        }
+
+        if (!isDebianPackage(path)) {
+            qWarning() << "Ignoring" << path << ": not a Debian package";
+            continue;
+        }
+
+        // 安装进行中打开的包作为后续任务，在同一次持锁期间接着安装
+        if (m_status == Installing) {
+            followUp << path;
+            continue;
+        }
+
+        m_queuedFiles << path;
+        queueChanged = true;
     }
-    
-    // 提取基本包信息
-    m_packageName = extractControlField("Package");
-    m_version = extractControlField("Version");
-    m_maintainer = extractControlField("Maintainer");
-    m_description = extractControlField("Description");
-    m_homePage = extractControlField("Homepage");
-    
-    // 处理描述字段（只取第一行）
-    int newlinePos = m_description.indexOf('\n');
-    if (newlinePos > 0) {
-        m_description = m_description.left(newlinePos);
+
+    if (!followUp.isEmpty()) {
+        m_installingFiles << followUp;
+        enqueueInstall(followUp);
     }
-    
-    // 获取安装大小
-    QString installedSizeStr = extractControlField("Installed-Size");
-    if (!installedSizeStr.isEmpty()) {
-        bool ok;
-        double size = installedSizeStr.toDouble(&ok);
-        if (ok) {
-            m_installedSize = formatByteSize(size * 1024.0, 1);
+
+    if (queueChanged) {
+        emit queuedFilesChanged();
+
+        // 队列变化后需要重新检查整个安装集合
+        if (m_isValid && m_status == Begin) {
+            startDependencyCheck();
         }
     }
-    
-    return !m_packageName.isEmpty();
 }
 
-void DebInstaller::updatePackageInfo()
+void DebInstaller::scanDirectory(const QString &directory)
 {
-    if (!m_aptInitialized || m_packageName.isEmpty()) {
-        m_isInstalled = false;
-        m_installedVersion.clear();
+    if (m_scanWatcher->isRunning()) {
+        if (!m_scanQueue.contains(directory)) {
+            m_scanQueue << directory;
+        }
         return;
     }
-    
-    pkgCache *cache = m_cacheFile->GetPkgCache();
-    if (!cache) {
-        m_isInstalled = false;
-        m_installedVersion.clear();
+
+    // 扫描在线程池中进行，完成后按普通的多个文件加入
+    m_scanWatcher->setFuture(QtConcurrent::run([directory]() {
+        return PackageScanner::scan(directory);
+    }));
+}
+
+bool DebInstaller::isDebianPackage(const QString &filePath) const
+{
+    // 只检查 ar 成员头，不加载 shared-mime-info 数据库
+    return DebArchive::validate(filePath) == DebArchive::Valid;
+}
+
+QStringList DebInstaller::installFiles() const
+{
+    return QStringList() << m_fileName << m_queuedFiles;
+}
+
+void DebInstaller::startDependencyCheck()
+{
+    m_additionalPackages.clear();
+
+    m_canInstall = false;
+    emit canInstallChanged();
+
+    // 异步检查依赖
+    if (!m_dependencyWatcher) {
+        m_dependencyWatcher = new QFutureWatcher<DependencyResult>(this);
+        connect(m_dependencyWatcher, &QFutureWatcher<DependencyResult>::finished, [this]() {
+            const DependencyResult result = m_dependencyWatcher->result();
+
+            // 检查期间打开了别的包或队列发生了变化，结论已经过期
+            if (result.files != installFiles() || result.root != m_root) {
+                return;
+            }
+
+            // 包已损坏时保留损坏的提示；占位包只有控制信息，下载完成前不能安装
+            m_additionalPackages = result.additionalPackages;
+            if (!m_archiveDamaged) {
+                m_preInstallMessage = result.message;
+            }
+            m_canInstall = result.canInstall && !m_archiveDamaged && !m_remote->isDownloading();
+            if (!m_canInstall && m_preInstallMessage.isEmpty()) {
+                m_preInstallMessage = tr("Error: Cannot satisfy dependencies");
+            }
+            emit canInstallChanged();
+            emit preInstallMessageChanged();
+
+            // 只缓存单个完整包的结论，下次打开时直接使用
+            if (m_queuedFiles.isEmpty() && !m_remote->isDownloading() && !m_archiveDamaged) {
+                AnalysisCache::Entry entry;
+                entry.package = m_packageName;
+                entry.version = m_version;
+                entry.maintainer = m_maintainer;
+                entry.description = m_description;
+                entry.homePage = m_homePage;
+                entry.installedSize = m_installedSize;
+                entry.canInstall = m_canInstall;
+                entry.message = m_preInstallMessage;
+                entry.additionalPackages = m_additionalPackages;
+                AnalysisCache::store(m_fileName, m_root, entry);
+            }
+        });
+    }
+
+    // 工作线程只读取传入的参数，不访问界面线程的成员
+    const QStringList files = installFiles();
+    const TargetRoot root = m_root;
+
+    // 拖入时已对同一个包开始检查，沿用它的结果；安装集合不同时丢弃
+    const QString speculativeFile = m_speculativeFile;
+    m_speculativeFile.clear();
+    if (!speculativeFile.isEmpty() && files == QStringList(speculativeFile)) {
+        m_dependencyWatcher->setFuture(m_speculativeCheck);
         return;
     }
-    
-    pkgCache::PkgIterator pkg = cache->FindPkg(m_packageName.toStdString());
-    if (pkg.end()) {
+
+    m_dependencyWatcher->setFuture(QtConcurrent::run([files, root]() {
+        return runDependencyCheck(files, root);
+    }));
+}
+
+void DebInstaller::startInstalledFilesCheck()
+{
+    // 只有重新安装同一版本时才有意义
+    if (!m_isInstalled || m_version != m_installedVersion) {
+        return;
+    }
+
+    m_reinstallStatus = tr("Checking installed files...");
+    emit reinstallStatusChanged();
+
+    const QString file = m_fileName;
+    const TargetRoot root = m_root;
+    m_filesCheckWatcher->setFuture(QtConcurrent::run([file, root]() {
+        return InstalledFiles::compare(file, root);
+    }));
+}
+
+void DebInstaller::startRepositoryCheck()
+{
+    m_repositoryStatus.clear();
+    emit repositoryStatusChanged();
+
+    // 下载中的占位包只有控制信息，与软件源中的文件必然不同
+    m_repositoryFile = m_fileName;
+    if (m_remote->isDownloading()) {
+        return;
+    }
+
+    const QString file = m_fileName;
+    const TargetRoot root = m_root;
+    m_repositoryWatcher->setFuture(QtConcurrent::run([file, root]() {
+        return RepositoryCheck::check(file, root);
+    }));
+}
+
+void DebInstaller::openNextQueuedFile()
+{
+    if (m_queuedFiles.isEmpty())
+        return;
+
+    QString next = m_queuedFiles.takeFirst();
+    emit queuedFilesChanged();
+
+    // 直接分析下一个包，依赖检查会重新打开该目标的 APT 缓存
+    setStatus(Begin);
+    m_fileName.clear();
+    setFileName(next);
+}
+
+void DebInstaller::preview(const QStringList &files)
+{
+    // 只有拖入单个本地文件且当前没有打开的包时，放下后才会立即打开它
+    if (files.size() != 1 || RemotePackage::isRemote(files.first())
+            || !m_fileName.isEmpty() || m_status == Installing) {
+        cancelPreview();
+        return;
+    }
+
+    const QString path = QFileInfo(QString(files.first()).remove("file://")).absoluteFilePath();
+    if (path == m_previewFile) {
+        return;
+    }
+
+    cancelPreview();
+    if (!isDebianPackage(path)) {
+        return;
+    }
+
+    m_previewFile = path;
+    m_previewCancelled = std::make_shared<std::atomic<bool>>(false);
+
+    // 放下时可能有排队的包而不使用缓存的结论，这里总是解析出完整的控制字段
+    const TargetRoot root = m_root;
+    const std::shared_ptr<std::atomic<bool>> cancelled = m_previewCancelled;
+    m_previewWatcher->setFuture(QtConcurrent::run([path, cancelled]() {
+        return readControlFields(path, cancelled.get());
+    }));
+
+    // 同时把包读入页缓存，放下后依赖检查可以立即开始
+    m_prefetcher->prefetch(path);
+
+    // 依赖检查同样提前开始；已有缓存的结论时不需要
+    AnalysisCache::Entry cached;
+    if (!AnalysisCache::lookup(path, root, cached)) {
+        m_speculativeFile = path;
+        m_speculativeCheck = QtConcurrent::run([path, root]() {
+            return runDependencyCheck(QStringList(path), root);
+        });
+    }
+}
+
+void DebInstaller::cancelPreview()
+{
+    if (m_previewFile.isEmpty()) {
+        return;
+    }
+
+    // 不等待后台解析结束，它会在下一个字段之前退出；提前开始的依赖检查无法中断，只丢弃其结果
+    m_previewCancelled->store(true);
+    m_previewFile.clear();
+    m_speculativeFile.clear();
+    m_speculativeCheck = QFuture<DependencyResult>();
+
+    if (m_fileName.isEmpty()) {
+        m_prefetcher->cancel();
+    }
+}
+
+DebInstaller::ControlFields DebInstaller::previewFields() const
+{
+    // 解析被取消或失败时重新读取，不把有效的包当作损坏
+    const ControlFields fields = m_previewWatcher->result();
+    if (fields.valid) {
+        return fields;
+    }
+    return readControlFields(m_fileName);
+}
+
+bool DebInstaller::parseDebFile(const ControlFields &fields)
+{
+    if (!fields.valid) {
+        return false;
+    }
+
+    // 提取基本包信息
+    m_packageName = fields.package;
+    m_version = fields.version;
+    m_maintainer = fields.maintainer;
+    m_description = fields.description;
+    m_homePage = fields.homePage;
+
+    // 获取安装大小
+    if (!fields.installedSize.isEmpty()) {
+        m_installedSize = formatInstalledSize(fields.installedSize);
+    }
+
+    return true;
+}
+
+bool DebInstaller::analyse(const QString &debFile, const TargetRoot &root)
+{
+    const ControlFields fields = readControlFields(debFile);
+    if (!fields.valid) {
+        return false;
+    }
+
+    const DependencyResult result = runDependencyCheck(QStringList() << debFile, root);
+
+    AnalysisCache::Entry entry;
+    entry.package = fields.package;
+    entry.version = fields.version;
+    entry.maintainer = fields.maintainer;
+    entry.description = fields.description;
+    entry.homePage = fields.homePage;
+    entry.installedSize = formatInstalledSize(fields.installedSize);
+    entry.canInstall = result.canInstall;
+    entry.message = result.message;
+    if (!entry.canInstall && entry.message.isEmpty()) {
+        entry.message = tr("Error: Cannot satisfy dependencies");
+    }
+    entry.additionalPackages = result.additionalPackages;
+    AnalysisCache::store(debFile, root, entry);
+    return true;
+}
+
+void DebInstaller::updatePackageInfo()
+{
+    if (!m_aptInitialized || m_packageName.isEmpty()) {
         m_isInstalled = false;
         m_installedVersion.clear();
-    } else {
-        m_isInstalled = (pkg->CurrentState == pkgCache::State::Installed);
-        if (pkg.CurrentVer()) {
-            m_installedVersion = QString::fromStdString(pkg.CurrentVer().VerStr());
-        } else {
-            m_installedVersion.clear();
-        }
+        return;
     }
-    
+
+    // 已安装的版本以 dpkg status 为准，监视器保持快照最新
+    const DpkgStatusWatcher::PackageState state = m_statusWatcher->state(m_packageName);
+    m_isInstalled = state.isInstalled();
+    m_installedVersion = state.isInstalled() ? state.version : QString();
+
     emit isInstalledChanged();
     emit installedVersionChanged();
     emit packageNameChanged();
@@ -246,35 +787,74 @@ void DebInstaller::updatePackageInfo()
     emit installedSizeChanged();
 }
 
-bool DebInstaller::checkDependencies()
+DebInstaller::DependencyResult DebInstaller::runDependencyCheck(const QStringList &files, const TargetRoot &root)
 {
-    // 使用 dpkg 检查依赖
-    QString output;
-    if (runDpkgCommand(QStringList() << "--dry-run" << "-i" << m_fileName, output)) {
-        // 如果 dry-run 成功，说明依赖满足
-        return true;
-    } else {
+    DependencyResult result = checkDependencies(files, root);
+    if (result.canInstall && (checkConflicts(files, root, result.message) || checkBreaksSystem())) {
+        result.canInstall = false;
+    }
+    return result;
+}
+
+DebInstaller::DependencyResult DebInstaller::checkDependencies(const QStringList &files, const TargetRoot &root)
+{
+    DependencyResult result;
+    result.files = files;
+    result.root = root;
+
+    // 使用 dpkg 检查依赖；多个包之间的依赖 dpkg --dry-run 会当作未安装，直接交给 APT 一起求解
+    if (files.size() == 1) {
+        QString output;
+        if (runDpkg(root, QStringList() << "--dry-run" << "-i" << files, output)) {
+            // 如果 dry-run 成功，说明依赖满足
+            result.canInstall = true;
+            return result;
+        }
+
         // 检查输出中是否包含依赖错误
-        if (output.contains("depends", Qt::CaseInsensitive) || 
-            output.contains("dependency", Qt::CaseInsensitive)) {
-            m_preInstallMessage = tr("Error: Unmet dependencies");
-            return false;
+        if (!output.contains("depends", Qt::CaseInsensitive) &&
+            !output.contains("dependency", Qt::CaseInsensitive)) {
+            result.canInstall = true;
+            return result;
         }
-        return true;
     }
+
+    // 尝试从已配置的软件源（包括本地镜像）中获取缺失的依赖
+    TargetRoot::Scope scope(root);
+    PackageTransaction transaction;
+    if (transaction.resolve(files) && transaction.removedPackages().isEmpty()) {
+        result.canInstall = true;
+        result.additionalPackages = transaction.additionalPackages();
+
+        QStringList messages;
+        if (!result.additionalPackages.isEmpty()) {
+            messages << tr("Additional packages will be installed: %1").arg(result.additionalPackages.join(", "));
+        }
+        if (transaction.installOrder().size() > 1) {
+            messages << tr("Install order: %1").arg(transaction.installOrder().join(", "));
+        }
+        result.message = messages.join("\n");
+        return result;
+    }
+
+    // 求解失败时显示原因（例如候选包之间的 Pre-Depends 环），第二行起是 APT 的详细错误
+    result.message = transaction.errorString().isEmpty()
+            ? tr("Error: Unmet dependencies")
+            : tr("Error: %1").arg(transaction.errorString().section('\n', 0, 0));
+    return result;
 }
 
-bool DebInstaller::checkConflicts()
+bool DebInstaller::checkConflicts(const QStringList &files, const TargetRoot &root, QString &message)
 {
     // 简化的冲突检查
     // 在实际应用中，这里应该进行更详细的检查
     QString output;
-    if (runDpkgCommand(QStringList() << "--dry-run" << "-i" << m_fileName, output)) {
+    if (runDpkg(root, QStringList() << "--dry-run" << "-i" << files, output)) {
         return false; // 没有冲突
     } else {
         // 检查输出中是否包含冲突信息
         if (output.contains("conflict", Qt::CaseInsensitive)) {
-            m_preInstallMessage = tr("Error: Package conflicts");
+            message = tr("Error: Package conflicts");
             return true;
         }
         return false;
@@ -294,60 +874,144 @@ void DebInstaller::install()
         return;
     }
     
+    beginInstall(tr("Starting installation"));
+    
+    // 使用 dpkg 安装 deb 包，队列中的包一并安装
+    m_installingFiles = installFiles();
+    for (const QString &file : m_installingFiles) {
+        m_queuedFiles.removeAll(file);
+    }
+    emit queuedFilesChanged();
+
+    // 通过 libapt 的包管理器安装，dpkg 锁被占用时排队等待
+    enqueueInstall(m_installingFiles);
+}
+
+void DebInstaller::repair()
+{
+    if (!m_isValid || m_modifiedFiles.isEmpty()) {
+        return;
+    }
+
+    beginInstall(tr("Restoring modified files"));
+
+    m_installingFiles = QStringList() << m_fileName;
+    m_modifiedFiles.clear();
+    m_reinstallStatus.clear();
+    emit reinstallStatusChanged();
+
+    QVariantMap options;
+    options["repair"] = true;
+    enqueueInstall(m_installingFiles, options);
+}
+
+void DebInstaller::beginInstall(const QString &message)
+{
     setStatus(Installing);
-    m_statusMessage = tr("Starting installation");
+    m_statusMessage = message;
     m_statusDetails.clear();
     emit statusMessageChanged();
     emit statusDetailsTextChanged();
     emit requestSwitchToInstallPage();
-    
-    // 使用 dpkg 安装 deb 包
-    QStringList arguments;
-    arguments << "-i" << m_fileName;
-    
-    m_installProcess->start("dpkg", arguments);
+
+    // dpkg 接下来会自己读取文件，不再与之争抢 IO
+    m_prefetcher->cancel();
+}
+
+void DebInstaller::enqueueInstall(const QStringList &files, const QVariantMap &extraOptions)
+{
+    if (m_pendingJobs.isEmpty()) {
+        m_progress = 0;
+        m_installSummary.clear();
+        m_timings.clear();
+        m_jobFailed = false;
+        emit progressChanged();
+        emit installSummaryChanged();
+        emit timingsChanged();
+    }
+
+    // 下载缺失的依赖并与本地包在同一次 dpkg 运行中安装
+    QVariantMap options = extraOptions;
+    options["deferTriggers"] = m_deferTriggers;
+    options["verify"] = m_verifyInstall;
+    options["profile"] = m_installProfile;
+    options["conffilePolicy"] = m_conffilePolicy;
+    options["debconfPolicy"] = "ask";
+    m_root.insertInto(options);
+    m_pendingJobs.insert(m_backend->enqueue(files, options));
 }
 
-void DebInstaller::onInstallFinished(int exitCode, QProcess::ExitStatus exitStatus)
+void DebInstaller::onJobStarted(int id, const QStringList &files)
 {
-    if (exitStatus == QProcess::NormalExit && exitCode == 0) {
+    Q_UNUSED(id);
+
+    QStringList names;
+    for (const QString &file : files) {
+        names << QFileInfo(file).fileName();
+    }
+
+    m_progress = 0;
+    m_statusMessage = tr("Installing %1").arg(names.join(", "));
+    emit progressChanged();
+    emit statusMessageChanged();
+}
+
+void DebInstaller::onJobFinished(int id, bool success, const QString &errorString, const QStringList &summary,
+                                 const QVariantList &timings)
+{
+    m_pendingJobs.remove(id);
+
+    // 任务失败时可能还有未回答的问题
+    if (!m_conffilePrompt.isEmpty()) {
+        m_conffilePrompt.clear();
+        emit conffilePromptChanged();
+    }
+    if (!m_debconfQuestions.isEmpty()) {
+        m_debconfQuestions.clear();
+        emit debconfQuestionsChanged();
+    }
+
+    if (!summary.isEmpty()) {
+        m_installSummary += (m_installSummary.isEmpty() ? "" : "\n") + summary.join("\n");
+        emit installSummaryChanged();
+    }
+
+    if (!timings.isEmpty()) {
+        m_timings += timings;
+        emit timingsChanged();
+    }
+
+    if (!success) {
+        m_jobFailed = true;
+
+        if (!errorString.isEmpty()) {
+            m_statusDetails += "\n" + tr("Error:") + "\n" + errorString;
+            emit statusDetailsTextChanged();
+        }
+    }
+
+    // 同一次持锁期间还有后续任务
+    if (!m_pendingJobs.isEmpty()) {
+        return;
+    }
+
+    if (!m_jobFailed) {
+        m_progress = 100;
+        emit progressChanged();
+
         setStatus(Succeeded);
         m_statusMessage = tr("Installation successful");
         m_isInstalled = true;
         emit isInstalledChanged();
+
+        m_statusWatcher->refresh();
     } else {
         setStatus(Error);
         m_statusMessage = tr("Installation failed");
-        
-        // 读取错误输出
-        QString errorOutput = m_installProcess->readAllStandardError();
-        if (errorOutput.isEmpty()) {
-            errorOutput = m_installProcess->readAllStandardOutput();
-        }
-        
-        if (!errorOutput.isEmpty()) {
-            m_statusDetails += "\n" + tr("Error:") + "\n" + errorOutput;
-            emit statusDetailsTextChanged();
-        }
     }
     emit statusMessageChanged();
 }
 
-void DebInstaller::onInstallOutput()
-{
-    QString output = m_installProcess->readAllStandardOutput();
-    if (!output.isEmpty()) {
-        m_statusDetails += output;
-        emit statusDetailsTextChanged();
-    }
-    
-    output = m_installProcess->readAllStandardError();
-    if (!output.isEmpty()) {
-        m_statusDetails += output;
-        emit statusDetailsTextChanged();
-    }
-}
-
 // Getter 方法实现
 QString DebInstaller::packageName() const { return m_packageName; }
 QString DebInstaller::version() const { return m_version; }
@@ -359,10 +1023,112 @@ QString DebInstaller::homePage() const { return m_homePage; }
 QString DebInstaller::installedSize() const { return m_installedSize; }
 QString DebInstaller::installedVersion() const { return m_installedVersion; }
 bool DebInstaller::isInstalled() const { return m_isInstalled; }
+PackageFilesModel *DebInstaller::files() const { return m_files; }
+QString DebInstaller::reinstallStatus() const { return m_reinstallStatus; }
+QStringList DebInstaller::modifiedFiles() const { return m_modifiedFiles; }
+QString DebInstaller::repositoryStatus() const { return m_repositoryStatus; }
 QString DebInstaller::statusDetails() const { return m_statusDetails; }
 QString DebInstaller::preInstallMessage() const { return m_preInstallMessage; }
 DebInstaller::Status DebInstaller::status() const { return m_status; }
 QString DebInstaller::statusMessage() const { return m_statusMessage; }
+double DebInstaller::progress() const { return m_progress; }
+QString DebInstaller::installSummary() const { return m_installSummary; }
+QVariantList DebInstaller::timings() const { return m_timings; }
+bool DebInstaller::deferTriggers() const { return m_deferTriggers; }
+
+void DebInstaller::setDeferTriggers(bool defer)
+{
+    if (m_deferTriggers != defer) {
+        m_deferTriggers = defer;
+        emit deferTriggersChanged();
+    }
+}
+
+bool DebInstaller::verifyInstall() const { return m_verifyInstall; }
+
+void DebInstaller::setVerifyInstall(bool verify)
+{
+    if (m_verifyInstall != verify) {
+        m_verifyInstall = verify;
+        emit verifyInstallChanged();
+    }
+}
+
+double DebInstaller::downloadProgress() const { return m_downloadProgress; }
+
+QString DebInstaller::installProfile() const { return m_installProfile; }
+
+void DebInstaller::setInstallProfile(const QString &profile)
+{
+    if (m_installProfile != profile) {
+        m_installProfile = profile;
+        // 一次性的系统不值得为提前发现损坏的包再完整解压一遍，只预读
+        m_prefetcher->setVerifyArchive(profile != "ephemeral");
+        emit installProfileChanged();
+    }
+}
+
+QString DebInstaller::conffilePolicy() const { return m_conffilePolicy; }
+
+void DebInstaller::setConffilePolicy(const QString &policy)
+{
+    if (m_conffilePolicy != policy) {
+        m_conffilePolicy = policy;
+        emit conffilePolicyChanged();
+    }
+}
+
+QString DebInstaller::rootDir() const { return m_root.rootDir(); }
+QString DebInstaller::adminDir() const { return m_root.adminDir(); }
+
+void DebInstaller::setTargetRoot(const QString &rootDir, const QString &adminDir)
+{
+    const TargetRoot root(rootDir, adminDir);
+    if (root == m_root || m_status == Installing) {
+        return;
+    }
+
+    cancelPreview();
+
+    // 旧目标上尚未完成的检查各自在自己的 Scope 中结束，结果按目标丢弃，不在界面线程等待
+    m_root = root;
+    watchStatus();
+
+    emit targetRootChanged();
+
+    // 已打开的包按新目标重新分析
+    if (m_isValid) {
+        updatePackageInfo();
+        startDependencyCheck();
+        startInstalledFilesCheck();
+    }
+}
+
+QString DebInstaller::conffilePrompt() const { return m_conffilePrompt; }
+
+void DebInstaller::answerConffile(bool replace)
+{
+    if (m_conffilePrompt.isEmpty()) {
+        return;
+    }
+
+    m_conffilePrompt.clear();
+    emit conffilePromptChanged();
+    m_backend->answerConffile(replace);
+}
+
+QVariantList DebInstaller::debconfQuestions() const { return m_debconfQuestions; }
+
+void DebInstaller::answerDebconf(const QVariantMap &values)
+{
+    if (m_debconfQuestions.isEmpty()) {
+        return;
+    }
+
+    m_debconfQuestions.clear();
+    emit debconfQuestionsChanged();
+    m_backend->answerDebconf(values);
+}
 
 void DebInstaller::setStatus(DebInstaller::Status status)
 {
@@ -372,7 +1138,15 @@ void DebInstaller::setStatus(DebInstaller::Status status)
     }
 }
 
-QString DebInstaller::formatByteSize(double size, int precision) const
+// Installed-Size 以 KiB 为单位，无法解析时为空
+QString DebInstaller::formatInstalledSize(const QString &kib)
+{
+    bool ok;
+    double size = kib.toDouble(&ok);
+    return ok ? formatByteSize(size * 1024.0, 1) : QString();
+}
+
+QString DebInstaller::formatByteSize(double size, int precision)
 {
     int unit = 0;
     double multiplier = 1024.0;
@@ -22,21 +22,39 @@
 #include <QObject>
 #include <QString>
 #include <QStringList>
-#include <QProcess>
 #include <QFutureWatcher>
 #include <QHash>
+#include <QSet>
 #include <QFile>
+#include <QVariantList>
+#include <QFuture>
+
+#include <atomic>
+#include <memory>
 
 // 只包含必要的 APT 头文件
-#include <apt-pkg/cachefile.h>
 #include <apt-pkg/pkgcache.h>
 #include <apt-pkg/init.h>
 #include <apt-pkg/error.h>
+#include <apt-pkg/pkgsystem.h>
+
+#include "packagefilesmodel.h"
+#include "installedfiles.h"
+#include "packagescanner.h"
+#include "repositorycheck.h"
+#include "targetroot.h"
+
+class DpkgStatusWatcher;
+class InstallBackend;
+class PackagePrefetcher;
+class RemotePackage;
 
 class DebInstaller : public QObject
 {
     Q_OBJECT
     Q_PROPERTY(QString fileName READ fileName WRITE setFileName NOTIFY fileNameChanged)
+    Q_PROPERTY(double downloadProgress READ downloadProgress NOTIFY downloadProgressChanged)
+    Q_PROPERTY(QStringList queuedFiles READ queuedFiles NOTIFY queuedFilesChanged)
     Q_PROPERTY(QString packageName READ packageName NOTIFY packageNameChanged)
     Q_PROPERTY(QString version READ version NOTIFY versionChanged)
     Q_PROPERTY(QString maintainer READ maintainer NOTIFY maintainerChanged)
@@ -44,13 +62,28 @@ class DebInstaller : public QObject
     Q_PROPERTY(QString homePage READ homePage NOTIFY homePageChanged)
     Q_PROPERTY(QString installedSize READ installedSize NOTIFY installedSizeChanged)
     Q_PROPERTY(QString installedVersion READ installedVersion NOTIFY installedVersionChanged)
+    Q_PROPERTY(PackageFilesModel *files READ files CONSTANT)
+    Q_PROPERTY(QString reinstallStatus READ reinstallStatus NOTIFY reinstallStatusChanged)
+    Q_PROPERTY(QStringList modifiedFiles READ modifiedFiles NOTIFY reinstallStatusChanged)
+    Q_PROPERTY(QString repositoryStatus READ repositoryStatus NOTIFY repositoryStatusChanged)
 
     Q_PROPERTY(QString statusMessage READ statusMessage NOTIFY statusMessageChanged)
     Q_PROPERTY(QString statusDetails READ statusDetails NOTIFY statusDetailsTextChanged)
     Q_PROPERTY(QString preInstallMessage READ preInstallMessage NOTIFY preInstallMessageChanged)
 
     Q_PROPERTY(Status status READ status NOTIFY statusChanged)
+    Q_PROPERTY(double progress READ progress NOTIFY progressChanged)
+    Q_PROPERTY(QString installSummary READ installSummary NOTIFY installSummaryChanged)
+    Q_PROPERTY(QVariantList timings READ timings NOTIFY timingsChanged)
+    Q_PROPERTY(bool deferTriggers READ deferTriggers WRITE setDeferTriggers NOTIFY deferTriggersChanged)
+    Q_PROPERTY(bool verifyInstall READ verifyInstall WRITE setVerifyInstall NOTIFY verifyInstallChanged)
+    Q_PROPERTY(QString installProfile READ installProfile WRITE setInstallProfile NOTIFY installProfileChanged)
+    Q_PROPERTY(QString conffilePolicy READ conffilePolicy WRITE setConffilePolicy NOTIFY conffilePolicyChanged)
+    Q_PROPERTY(QString conffilePrompt READ conffilePrompt NOTIFY conffilePromptChanged)
+    Q_PROPERTY(QVariantList debconfQuestions READ debconfQuestions NOTIFY debconfQuestionsChanged)
     Q_PROPERTY(bool isInstalled READ isInstalled NOTIFY isInstalledChanged)
+    Q_PROPERTY(QString rootDir READ rootDir NOTIFY targetRootChanged)
+    Q_PROPERTY(QString adminDir READ adminDir NOTIFY targetRootChanged)
 
     Q_PROPERTY(bool valid READ isValid NOTIFY isValidChanged)
     Q_PROPERTY(bool canInstall READ canInstall NOTIFY canInstallChanged)
@@ -67,9 +100,25 @@ public:
     explicit DebInstaller(QObject *parent = nullptr);
     ~DebInstaller();
 
+    // 也接受 http(s) 地址与目录，目录中去重后的包依次打开
     QString fileName() const;
     void setFileName(const QString &fileName);
 
+    // 远程包的下载进度（0 到 1），没有在下载时为 -1
+    double downloadProgress() const;
+
+    QStringList queuedFiles() const;
+    Q_INVOKABLE void addFiles(const QStringList &files);
+    Q_INVOKABLE void openNextQueuedFile();
+
+    // 后台预分析：只解析控制信息并检查依赖，结论写入 AnalysisCache；阻塞调用，
+    // 不需要界面、安装后端与预读。包无效时返回 false
+    static bool analyse(const QString &debFile, const TargetRoot &root = TargetRoot());
+
+    // 拖入窗口时提前在后台解析单个包，放下时直接使用结果，拖出时丢弃
+    Q_INVOKABLE void preview(const QStringList &files);
+    Q_INVOKABLE void cancelPreview();
+
     QString packageName() const;
     QString version() const;
     QString maintainer() const;
@@ -83,17 +132,58 @@ public:
     QString installedVersion() const;
 
     bool isInstalled() const;
+    PackageFilesModel *files() const;
 
     Q_INVOKABLE void install();
 
+    // 同一版本已安装时只恢复被改动的文件
+    QString reinstallStatus() const;
+    QStringList modifiedFiles() const;
+    Q_INVOKABLE void repair();
+
+    // 与软件源中同一版本的文件是否相同，软件源中没有该版本时为空
+    QString repositoryStatus() const;
+
     QString statusMessage() const;
     QString statusDetails() const;
     QString preInstallMessage() const;
 
     Status status() const;
+    double progress() const;
+    QString installSummary() const;
+    QVariantList timings() const;
+
+    bool deferTriggers() const;
+    void setDeferTriggers(bool defer);
+
+    // 安装完成后校验已安装的文件，通过后才显示安装成功
+    bool verifyInstall() const;
+    void setVerifyInstall(bool verify);
+
+    // "safe"、"fast"（后台低优先级安装）或 "ephemeral"（不 fsync，用于虚拟机与容器）
+    QString installProfile() const;
+    void setInstallProfile(const QString &profile);
+
+    // "keep"、"replace" 或 "ask"（在安装页中询问）
+    QString conffilePolicy() const;
+    void setConffilePolicy(const QString &policy);
+
+    QString conffilePrompt() const;
+    Q_INVOKABLE void answerConffile(bool replace);
+
+    QVariantList debconfQuestions() const;
+    Q_INVOKABLE void answerDebconf(const QVariantMap &values);
+
+    // 安装目标，默认为主机；镜像构建或 chroot 时指向另一个根目录，
+    // adminDir 为空时使用 <rootDir>/var/lib/dpkg
+    QString rootDir() const;
+    QString adminDir() const;
+    Q_INVOKABLE void setTargetRoot(const QString &rootDir, const QString &adminDir = QString());
 
 signals:
     void fileNameChanged();
+    void downloadProgressChanged();
+    void queuedFilesChanged();
     void packageNameChanged();
     void versionChanged();
     void maintainerChanged();
@@ -106,41 +196,127 @@ signals:
     void statusMessageChanged();
     void statusDetailsTextChanged();
     void statusChanged();
+    void progressChanged();
+    void installSummaryChanged();
+    void timingsChanged();
+    void deferTriggersChanged();
+    void verifyInstallChanged();
+    void installProfileChanged();
+    void conffilePolicyChanged();
+    void conffilePromptChanged();
+    void debconfQuestionsChanged();
     void isInstalledChanged();
+    void targetRootChanged();
 
     void requestSwitchToInstallPage();
     void preInstallMessageChanged();
+    void reinstallStatusChanged();
+    void repositoryStatusChanged();
 
 private:
+    // 包中 control 文件的字段，Installed-Size 保留原始的 KiB 数
+    struct ControlFields {
+        bool valid = false;
+        QString package;
+        QString version;
+        QString maintainer;
+        QString description;
+        QString homePage;
+        QString installedSize;
+    };
+
+    // 依赖检查在线程池中完成，结论回到界面线程后再应用
+    struct DependencyResult {
+        QStringList files;
+        TargetRoot root;
+        bool canInstall = false;
+        QStringList additionalPackages;
+        QString message;
+    };
+
     bool initializeApt();
-    bool parseDebFile();
+    void openFile(const QString &fileName);
+    void scanDirectory(const QString &directory);
+    void watchStatus();
+    void finishOpen(const ControlFields &fields);
+    void startFileChecks();
+    bool parseDebFile(const ControlFields &fields);
+    ControlFields previewFields() const;
     void setStatus(Status status);
+
+    bool isDebianPackage(const QString &filePath) const;
+    QStringList installFiles() const;
+    void startDependencyCheck();
+    void startInstalledFilesCheck();
+    void startRepositoryCheck();
     
-    bool checkDependencies();
-    bool checkConflicts();
-    bool checkBreaksSystem();
+    static DependencyResult runDependencyCheck(const QStringList &files, const TargetRoot &root);
+    static DependencyResult checkDependencies(const QStringList &files, const TargetRoot &root);
+    static bool checkConflicts(const QStringList &files, const TargetRoot &root, QString &message);
+    static bool checkBreaksSystem();
     void updatePackageInfo();
     
-    QString formatByteSize(double size, int precision) const;
-    QString extractControlField(const QString &fieldName) const;
-    bool runDpkgCommand(const QStringList &arguments, QString &output) const;
+    static QString formatByteSize(double size, int precision);
+    static QString formatInstalledSize(const QString &kib);
+    static bool runDpkg(const TargetRoot &root, const QStringList &arguments, QString &output);
+    static ControlFields readControlFields(const QString &debFile, const std::atomic<bool> *cancelled = nullptr);
+    void beginInstall(const QString &message);
+    void enqueueInstall(const QStringList &files, const QVariantMap &extraOptions = QVariantMap());
 
 private slots:
-    void onInstallFinished(int exitCode, QProcess::ExitStatus exitStatus);
-    void onInstallOutput();
+    void onJobStarted(int id, const QStringList &files);
+    void onJobFinished(int id, bool success, const QString &errorString, const QStringList &summary,
+                       const QVariantList &timings);
+    void onPackagesChanged(const QStringList &packageNames);
+    void onPrefetchFinished(const QString &debFile, bool archiveOk, qint64 elapsed);
 
 private:
-    // APT 相关成员
-    pkgCacheFile *m_cacheFile;
+    // 已安装包的状态快照
+    DpkgStatusWatcher *m_statusWatcher;
+
+    InstallBackend *m_backend;
+    QSet<int> m_pendingJobs;
+    bool m_jobFailed;
     
-    QProcess *m_installProcess;
-    QFutureWatcher<bool> *m_dependencyWatcher;
+    QFutureWatcher<DependencyResult> *m_dependencyWatcher;
+
+    PackagePrefetcher *m_prefetcher;
+    PackageFilesModel *m_files;
+    RemotePackage *m_remote;
+    double m_downloadProgress;
+
+    // 正在扫描的目录完成前，后来加入的目录在此排队
+    QFutureWatcher<PackageScanner::Result> *m_scanWatcher;
+    QStringList m_scanQueue;
+
+    // 拖入的文件在放下前为 m_previewFile，放下时解析尚未完成则记在 m_previewOpening 中等待
+    QString m_previewFile;
+    QString m_previewOpening;
+    QFutureWatcher<ControlFields> *m_previewWatcher;
+    std::shared_ptr<std::atomic<bool>> m_previewCancelled;
+
+    // 拖入时对 m_speculativeFile 单独开始的依赖检查，放下后安装集合仍只有它时直接沿用
+    QString m_speculativeFile;
+    QFuture<DependencyResult> m_speculativeCheck;
+
+    QFutureWatcher<InstalledFiles::Comparison> *m_filesCheckWatcher;
+    QString m_reinstallStatus;
+
+    QFutureWatcher<RepositoryCheck::Result> *m_repositoryWatcher;
+    QString m_repositoryFile;
+    QString m_repositoryStatus;
+    QStringList m_modifiedFiles;
+    bool m_archiveDamaged;
     
     bool m_isValid;
     bool m_canInstall;
     bool m_aptInitialized;
+    TargetRoot m_root;
 
     QString m_fileName;
+    QStringList m_queuedFiles;
+    QStringList m_installingFiles;
+    QStringList m_additionalPackages;
     QString m_packageName;
     QString m_version;
     QString m_maintainer;
@@ -155,6 +331,15 @@ private:
     QString m_preInstallMessage;
 
     Status m_status;
+    double m_progress;
+    QString m_installSummary;
+    QVariantList m_timings;
+    bool m_deferTriggers;
+    bool m_verifyInstall;
+    QString m_installProfile;
+    QString m_conffilePolicy;
+    QString m_conffilePrompt;
+    QVariantList m_debconfQuestions;
     
     QHash<QString, QString> m_controlFields;
 };
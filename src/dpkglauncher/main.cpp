@@ -0,0 +1,136 @@
+/*
+ * Copyright (C) 2021 Cutefish Technology Co., Ltd.
+ *
+ * Author:     Reion Wong <reion@cutefishos.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// 安装期间 APT 用它代替 dpkg（Dir::Bin::dpkg）。APT fork 出本程序后，
+// 只在这个单线程的子进程中设置 dpkg 的标准输入输出、环境变量与优先级，然后 exec 真正的 dpkg，
+// 安装程序自身的描述符与环境不受影响。
+//
+// 本程序的参数经 DPkg::Options 传入，以 --debinstaller- 开头，其余参数原样交给 dpkg：
+//   --debinstaller-dpkg=<路径>         真正的 dpkg，默认为 dpkg
+//   --debinstaller-stdin=<fd>          作为标准输入
+//   --debinstaller-output=<fd>         作为标准输出与标准错误
+//   --debinstaller-setenv=<名称>=<值>  设置环境变量
+//   --debinstaller-background          以较低的 CPU 与 IO 优先级运行
+//   --debinstaller-cgroup=<目录>       先把自己移入这个 cgroup v2，dpkg 与维护脚本都留在其中
+
+#include "iopriority.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+static const char Prefix[] = "--debinstaller-";
+
+static bool startsWith(const std::string &text, const char *prefix)
+{
+    return text.compare(0, std::strlen(prefix), prefix) == 0;
+}
+
+static bool redirect(const std::string &fd, int target)
+{
+    const int source = std::atoi(fd.c_str());
+    if (source <= STDERR_FILENO) {
+        return false;
+    }
+    return ::dup2(source, target) >= 0;
+}
+
+// 本进程只有一个线程，写入 0 只移动自己，不影响安装程序
+static bool joinCgroup(const std::string &path)
+{
+    const int fd = ::open((path + "/cgroup.procs").c_str(), O_WRONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    const bool ok = ::write(fd, "0", 1) == 1;
+    ::close(fd);
+    return ok;
+}
+
+int main(int argc, char *argv[])
+{
+    std::string dpkg = "dpkg";
+    std::vector<int> passedFds;
+    std::vector<std::string> arguments;
+
+    for (int i = 1; i < argc; ++i) {
+        const std::string argument = argv[i];
+        if (!startsWith(argument, Prefix)) {
+            arguments.push_back(argument);
+            continue;
+        }
+
+        const std::string option = argument.substr(sizeof(Prefix) - 1);
+        bool ok = true;
+        if (startsWith(option, "dpkg=")) {
+            dpkg = option.substr(5);
+        } else if (startsWith(option, "stdin=")) {
+            ok = redirect(option.substr(6), STDIN_FILENO);
+            passedFds.push_back(std::atoi(option.substr(6).c_str()));
+        } else if (startsWith(option, "output=")) {
+            ok = redirect(option.substr(7), STDOUT_FILENO) && redirect(option.substr(7), STDERR_FILENO);
+            passedFds.push_back(std::atoi(option.substr(7).c_str()));
+        } else if (startsWith(option, "setenv=")) {
+            const std::string variable = option.substr(7);
+            const std::string::size_type equal = variable.find('=');
+            ok = equal != std::string::npos && equal > 0
+                    && ::setenv(variable.substr(0, equal).c_str(), variable.substr(equal + 1).c_str(), 1) == 0;
+        } else if (startsWith(option, "cgroup=")) {
+            // 没能加入时仍然安装，只是不受限制
+            if (!joinCgroup(option.substr(7))) {
+                std::fprintf(stderr, "%s: failed to join cgroup %s: %s\n", argv[0], option.substr(7).c_str(), std::strerror(errno));
+            }
+        } else if (option == "background") {
+            ::setpriority(PRIO_PROCESS, 0, 10);
+            IoPriority::set(IoPriority::BestEffort, 7);
+        } else {
+            ok = false;
+        }
+
+        if (!ok) {
+            std::fprintf(stderr, "%s: invalid option %s\n", argv[0], argument.c_str());
+            return 2;
+        }
+    }
+
+    // 已经接到 0、1、2 上的原描述符不再需要，不留给 dpkg 与维护脚本
+    for (int fd : passedFds) {
+        if (fd > STDERR_FILENO) {
+            ::close(fd);
+        }
+    }
+
+    std::vector<char *> dpkgArgv;
+    dpkgArgv.push_back(const_cast<char *>(dpkg.c_str()));
+    for (std::string &argument : arguments) {
+        dpkgArgv.push_back(&argument[0]);
+    }
+    dpkgArgv.push_back(nullptr);
+
+    ::execvp(dpkg.c_str(), dpkgArgv.data());
+    std::fprintf(stderr, "%s: failed to run %s: %s\n", argv[0], dpkg.c_str(), std::strerror(errno));
+    return 100;
+}
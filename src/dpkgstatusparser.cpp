@@ -0,0 +1,105 @@
+/*
+ * Copyright (C) 2021 Cutefish Technology Co., Ltd.
+ *
+ * Author:     Reion Wong <reion@cutefishos.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "dpkgstatusparser.h"
+
+DpkgStatusParser::DpkgStatusParser()
+{
+    m_timer.start();
+}
+
+void DpkgStatusParser::feed(const QByteArray &data)
+{
+    m_buffer.append(data);
+
+    int pos;
+    while ((pos = m_buffer.indexOf('\n')) >= 0) {
+        QByteArray line = m_buffer.left(pos);
+        m_buffer.remove(0, pos + 1);
+
+        Event event;
+        if (parseLine(line, event)) {
+            event.timestamp = m_timer.elapsed();
+            m_events << event;
+        }
+    }
+}
+
+QList<DpkgStatusParser::Event> DpkgStatusParser::takeEvents()
+{
+    QList<Event> events;
+    events.swap(m_events);
+    return events;
+}
+
+qint64 DpkgStatusParser::elapsed() const
+{
+    return m_timer.elapsed();
+}
+
+bool DpkgStatusParser::parseLine(const QByteArray &line, Event &event)
+{
+    const QString text = QString::fromUtf8(line).trimmed();
+    event.timestamp = 0;
+
+    if (text.startsWith("status: ")) {
+        const QString rest = text.mid(8);
+
+        // 错误与配置文件提示使用 " : " 分隔，包名本身可能带有 ":arch"
+        int errorPos = rest.indexOf(" : error : ");
+        if (errorPos > 0) {
+            event.type = Event::Error;
+            event.package = rest.left(errorPos);
+            event.value = rest.mid(errorPos + 11);
+            return true;
+        }
+
+        int promptPos = rest.indexOf(" : conffile-prompt : ");
+        if (promptPos > 0) {
+            event.type = Event::ConffilePrompt;
+            event.package = rest.left(promptPos);
+            event.value = rest.mid(promptPos + 21);
+            return true;
+        }
+
+        int pos = rest.indexOf(": ");
+        if (pos <= 0) {
+            return false;
+        }
+
+        event.type = Event::Status;
+        event.package = rest.left(pos);
+        event.value = rest.mid(pos + 2);
+        return true;
+    }
+
+    if (text.startsWith("processing: ")) {
+        const QString rest = text.mid(12);
+        int pos = rest.indexOf(": ");
+        if (pos <= 0) {
+            return false;
+        }
+
+        event.type = Event::Processing;
+        event.value = rest.left(pos);
+        event.package = rest.mid(pos + 2);
+        return true;
+    }
+
+    return false;
+}
@@ -0,0 +1,59 @@
+/*
+ * Copyright (C) 2021 Cutefish Technology Co., Ltd.
+ *
+ * Author:     Reion Wong <reion@cutefishos.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef DPKGSTATUSPARSER_H
+#define DPKGSTATUSPARSER_H
+
+#include <QString>
+#include <QByteArray>
+#include <QList>
+#include <QElapsedTimer>
+
+// 解析 dpkg --status-fd 输出的状态行，并记录单调时钟时间戳
+class DpkgStatusParser
+{
+public:
+    struct Event {
+        enum Type {
+            Status,          // status: <pkg>: <state>
+            Processing,      // processing: <stage>: <pkg>
+            Error,           // status: <pkg> : error : <message>
+            ConffilePrompt,  // status: <conffile> : conffile-prompt : ...
+        };
+
+        Type type;
+        QString package;   // 包名，ConffilePrompt 时为配置文件路径
+        QString value;     // 状态、阶段或错误信息
+        qint64 timestamp;  // 相对于解析开始的毫秒数
+    };
+
+    DpkgStatusParser();
+
+    void feed(const QByteArray &data);
+    QList<Event> takeEvents();
+    qint64 elapsed() const;
+
+    static bool parseLine(const QByteArray &line, Event &event);
+
+private:
+    QElapsedTimer m_timer;
+    QByteArray m_buffer;
+    QList<Event> m_events;
+};
+
+#endif // DPKGSTATUSPARSER_H
@@ -0,0 +1,175 @@
+/*
+ * Copyright (C) 2021 Cutefish Technology Co., Ltd.
+ *
+ * Author:     Reion Wong <reion@cutefishos.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "dpkgstatuswatcher.h"
+#include <QFileSystemWatcher>
+#include <QFile>
+#include <QTimer>
+#include <QDebug>
+#include <QtConcurrent/QtConcurrent>
+
+DpkgStatusWatcher::DpkgStatusWatcher(const QString &adminDir, QObject *parent)
+    : QObject(parent)
+    , m_adminDir(adminDir)
+    , m_statusFile(adminDir + "/status")
+    , m_infoDir(adminDir + "/info")
+    , m_watcher(new QFileSystemWatcher(this))
+    , m_debounceTimer(new QTimer(this))
+    , m_parseWatcher(new QFutureWatcher<Snapshot>(this))
+    , m_pendingRefresh(false)
+    , m_ready(false)
+{
+    m_watcher->addPath(m_statusFile);
+    m_watcher->addPath(m_infoDir);
+
+    // dpkg 安装过程中会频繁修改，合并短时间内的多次变化
+    m_debounceTimer->setSingleShot(true);
+    m_debounceTimer->setInterval(500);
+
+    connect(m_watcher, &QFileSystemWatcher::fileChanged, this, &DpkgStatusWatcher::onPathChanged);
+    connect(m_watcher, &QFileSystemWatcher::directoryChanged, this, &DpkgStatusWatcher::onPathChanged);
+    connect(m_debounceTimer, &QTimer::timeout, this, &DpkgStatusWatcher::refresh);
+    connect(m_parseWatcher, &QFutureWatcher<Snapshot>::finished, this, &DpkgStatusWatcher::onParseFinished);
+
+    // 初始快照在线程池中读取，不拖慢启动
+    refresh();
+}
+
+bool DpkgStatusWatcher::isReady() const
+{
+    return m_ready;
+}
+
+bool DpkgStatusWatcher::contains(const QString &packageName) const
+{
+    return m_snapshot.contains(packageName);
+}
+
+DpkgStatusWatcher::PackageState DpkgStatusWatcher::state(const QString &packageName) const
+{
+    return m_snapshot.value(packageName);
+}
+
+void DpkgStatusWatcher::refresh()
+{
+    m_debounceTimer->stop();
+
+    if (m_parseWatcher->isRunning()) {
+        m_pendingRefresh = true;
+        return;
+    }
+
+    QString statusFile = m_statusFile;
+    m_parseWatcher->setFuture(QtConcurrent::run([statusFile]() {
+        return parseStatusFile(statusFile);
+    }));
+}
+
+void DpkgStatusWatcher::onPathChanged()
+{
+    // dpkg 通过 rename 替换 status 文件，监视会失效，需要重新添加
+    if (!m_watcher->files().contains(m_statusFile) && QFile::exists(m_statusFile)) {
+        m_watcher->addPath(m_statusFile);
+    }
+
+    m_debounceTimer->start();
+}
+
+void DpkgStatusWatcher::onParseFinished()
+{
+    Snapshot snapshot = m_parseWatcher->result();
+
+    // 第一次读取只是建立快照，不算作变化
+    if (!m_ready) {
+        m_snapshot = snapshot;
+        m_ready = true;
+        emit ready();
+
+        if (m_pendingRefresh) {
+            m_pendingRefresh = false;
+            refresh();
+        }
+        return;
+    }
+
+    QStringList changed;
+
+    for (auto it = snapshot.constBegin(); it != snapshot.constEnd(); ++it) {
+        auto old = m_snapshot.constFind(it.key());
+        if (old == m_snapshot.constEnd() || old.value() != it.value()) {
+            changed << it.key();
+        }
+    }
+
+    for (auto it = m_snapshot.constBegin(); it != m_snapshot.constEnd(); ++it) {
+        if (!snapshot.contains(it.key())) {
+            changed << it.key();
+        }
+    }
+
+    m_snapshot = snapshot;
+
+    if (!changed.isEmpty()) {
+        emit packagesChanged(changed);
+    }
+
+    if (m_pendingRefresh) {
+        m_pendingRefresh = false;
+        refresh();
+    }
+}
+
+DpkgStatusWatcher::Snapshot DpkgStatusWatcher::parseStatusFile(const QString &fileName)
+{
+    Snapshot snapshot;
+
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        qWarning() << "Failed to open" << fileName;
+        return snapshot;
+    }
+
+    QString package;
+    PackageState state;
+
+    auto commit = [&]() {
+        // 同名多架构时优先保留已安装的记录
+        if (!package.isEmpty() && (!snapshot.value(package).isInstalled() || state.isInstalled())) {
+            snapshot.insert(package, state);
+        }
+        package.clear();
+        state = PackageState();
+    };
+
+    while (!file.atEnd()) {
+        QByteArray line = file.readLine();
+
+        if (line.trimmed().isEmpty()) {
+            commit();
+        } else if (line.startsWith("Package:")) {
+            package = QString::fromUtf8(line.mid(8).trimmed());
+        } else if (line.startsWith("Status:")) {
+            state.status = QString::fromUtf8(line.mid(7).trimmed());
+        } else if (line.startsWith("Version:")) {
+            state.version = QString::fromUtf8(line.mid(8).trimmed());
+        }
+    }
+    commit();
+
+    return snapshot;
+}
@@ -0,0 +1,84 @@
+/*
+ * Copyright (C) 2021 Cutefish Technology Co., Ltd.
+ *
+ * Author:     Reion Wong <reion@cutefishos.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef DPKGSTATUSWATCHER_H
+#define DPKGSTATUSWATCHER_H
+
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QHash>
+#include <QFutureWatcher>
+
+class QFileSystemWatcher;
+class QTimer;
+
+class DpkgStatusWatcher : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct PackageState {
+        QString version;
+        QString status;
+
+        bool isInstalled() const { return status == "install ok installed"; }
+        bool operator==(const PackageState &other) const {
+            return version == other.version && status == other.status;
+        }
+        bool operator!=(const PackageState &other) const { return !(*this == other); }
+    };
+
+    typedef QHash<QString, PackageState> Snapshot;
+
+    explicit DpkgStatusWatcher(const QString &adminDir = "/var/lib/dpkg", QObject *parent = nullptr);
+
+    // 初始快照读取完成之前 state() 返回空状态
+    bool isReady() const;
+
+    bool contains(const QString &packageName) const;
+    PackageState state(const QString &packageName) const;
+
+    // 立即重新读取 status 文件（例如安装刚结束时）
+    void refresh();
+
+    static Snapshot parseStatusFile(const QString &fileName);
+
+signals:
+    void ready();
+    void packagesChanged(const QStringList &packageNames);
+
+private slots:
+    void onPathChanged();
+    void onParseFinished();
+
+private:
+    QString m_adminDir;
+    QString m_statusFile;
+    QString m_infoDir;
+
+    QFileSystemWatcher *m_watcher;
+    QTimer *m_debounceTimer;
+    QFutureWatcher<Snapshot> *m_parseWatcher;
+    bool m_pendingRefresh;
+    bool m_ready;
+
+    Snapshot m_snapshot;
+};
+
+#endif // DPKGSTATUSWATCHER_H
@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2021 Cutefish Technology Co., Ltd.
+ *
+ * Author:     Reion Wong <reion@cutefishos.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "folderwatcher.h"
+#include <QDir>
+#include <QFile>
+#include <QSocketNotifier>
+
+#include <sys/inotify.h>
+#include <unistd.h>
+
+FolderWatcher::FolderWatcher(QObject *parent)
+    : QObject(parent)
+    , m_fd(::inotify_init1(IN_NONBLOCK | IN_CLOEXEC))
+    , m_notifier(nullptr)
+{
+    if (m_fd >= 0) {
+        m_notifier = new QSocketNotifier(m_fd, QSocketNotifier::Read, this);
+        connect(m_notifier, &QSocketNotifier::activated, this, &FolderWatcher::onReadable);
+    }
+}
+
+FolderWatcher::~FolderWatcher()
+{
+    if (m_fd >= 0) {
+        ::close(m_fd);
+    }
+}
+
+bool FolderWatcher::addPath(const QString &directory)
+{
+    if (m_fd < 0) {
+        return false;
+    }
+
+    const QString path = QDir(directory).absolutePath();
+    const int wd = ::inotify_add_watch(m_fd, QFile::encodeName(path).constData(),
+                                       IN_CLOSE_WRITE | IN_MOVED_TO | IN_ONLYDIR);
+    if (wd < 0) {
+        return false;
+    }
+
+    m_directories.insert(wd, path);
+    return true;
+}
+
+void FolderWatcher::onReadable()
+{
+    // 事件按 inotify_event 对齐，一次读取可能包含多个事件
+    alignas(struct inotify_event) char buffer[16 * 1024];
+    ssize_t size;
+    while ((size = ::read(m_fd, buffer, sizeof(buffer))) > 0) {
+        for (char *p = buffer; p < buffer + size; ) {
+            const struct inotify_event *event = reinterpret_cast<const struct inotify_event *>(p);
+            p += sizeof(struct inotify_event) + event->len;
+
+            if (event->len == 0 || (event->mask & IN_ISDIR)) {
+                continue;
+            }
+
+            const QString name = QFile::decodeName(event->name);
+            if (name.endsWith(".deb") && m_directories.contains(event->wd)) {
+                emit packageArrived(m_directories.value(event->wd) + "/" + name);
+            }
+        }
+    }
+}
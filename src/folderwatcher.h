@@ -0,0 +1,52 @@
+/*
+ * Copyright (C) 2021 Cutefish Technology Co., Ltd.
+ *
+ * Author:     Reion Wong <reion@cutefishos.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef FOLDERWATCHER_H
+#define FOLDERWATCHER_H
+
+#include <QObject>
+#include <QHash>
+#include <QString>
+
+class QSocketNotifier;
+
+// 用 inotify 监视下载目录。只关心写完关闭（IN_CLOSE_WRITE）与移入（IN_MOVED_TO，
+// 浏览器下载完成时把临时文件改名）的 .deb，下载过程中的写入不会触发
+class FolderWatcher : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit FolderWatcher(QObject *parent = nullptr);
+    ~FolderWatcher();
+
+    bool addPath(const QString &directory);
+
+signals:
+    void packageArrived(const QString &fileName);
+
+private slots:
+    void onReadable();
+
+private:
+    int m_fd;
+    QSocketNotifier *m_notifier;
+    QHash<int, QString> m_directories;
+};
+
+#endif // FOLDERWATCHER_H
@@ -0,0 +1,374 @@
+/*
+ * Copyright (C) 2021 Cutefish Technology Co., Ltd.
+ *
+ * Author:     Reion Wong <reion@cutefishos.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "installhelper.h"
+#include "installscheduler.h"
+#include "helperclient.h"
+#include "targetroot.h"
+#include <QCoreApplication>
+#include <QDBusArgument>
+#include <QDBusMetaType>
+#include <QDBusPendingCallWatcher>
+#include <QDBusPendingReply>
+#include <QFileInfo>
+#include <QTimer>
+#include <QDebug>
+
+#include <limits>
+
+struct PolkitSubject {
+    QString kind;
+    QVariantMap details;
+};
+Q_DECLARE_METATYPE(PolkitSubject)
+
+struct PolkitResult {
+    bool isAuthorized = false;
+    bool isChallenge = false;
+    QMap<QString, QString> details;
+};
+Q_DECLARE_METATYPE(PolkitResult)
+
+typedef QMap<QString, QString> PolkitDetails;
+Q_DECLARE_METATYPE(PolkitDetails)
+
+QDBusArgument &operator<<(QDBusArgument &argument, const PolkitSubject &subject)
+{
+    argument.beginStructure();
+    argument << subject.kind << subject.details;
+    argument.endStructure();
+    return argument;
+}
+
+const QDBusArgument &operator>>(const QDBusArgument &argument, PolkitSubject &subject)
+{
+    argument.beginStructure();
+    argument >> subject.kind >> subject.details;
+    argument.endStructure();
+    return argument;
+}
+
+QDBusArgument &operator<<(QDBusArgument &argument, const PolkitResult &result)
+{
+    argument.beginStructure();
+    argument << result.isAuthorized << result.isChallenge << result.details;
+    argument.endStructure();
+    return argument;
+}
+
+const QDBusArgument &operator>>(const QDBusArgument &argument, PolkitResult &result)
+{
+    argument.beginStructure();
+    argument >> result.isAuthorized >> result.isChallenge >> result.details;
+    argument.endStructure();
+    return argument;
+}
+
+static const char *InstallAction = "com.cutefish.debinstaller.install";
+static const char *InstallRootAction = "com.cutefish.debinstaller.install-root";
+static const int AuthorizationTimeout = 5 * 60 * 1000;
+
+// 只接受客户端可以设置的选项并检查取值，debconfSocket 等由调度器填写的选项不能从外部传入；
+// 目标目录换成真实路径，之后把其中的符号链接换掉也不会改变安装位置
+static bool sanitizeOptions(const QVariantMap &options, QVariantMap &sanitized, QString &errorString)
+{
+    auto isBool = [](const QVariant &value) {
+        return value.userType() == QMetaType::Bool;
+    };
+    auto inRange = [](const QVariant &value, qlonglong min, qlonglong max) {
+        bool ok = false;
+        const qlonglong number = value.toLongLong(&ok);
+        return ok && number >= min && number <= max;
+    };
+    auto oneOf = [](const QVariant &value, const QStringList &allowed) {
+        return value.userType() == QMetaType::QString && allowed.contains(value.toString());
+    };
+
+    for (auto it = options.constBegin(); it != options.constEnd(); ++it) {
+        const QString &key = it.key();
+        const QVariant &value = it.value();
+
+        bool valid = false;
+        if (key == "deferTriggers" || key == "verify" || key == "repair") {
+            valid = isBool(value);
+        } else if (key == "conffilePolicy") {
+            valid = oneOf(value, { "keep", "replace" });
+        } else if (key == "debconfPolicy") {
+            valid = oneOf(value, { "ask", "defaults" });
+        } else if (key == "profile") {
+            valid = oneOf(value, { "safe", "fast", "ephemeral" });
+        } else if (key == "cpuWeight" || key == "ioWeight") {
+            valid = inRange(value, 1, 10000);
+        } else if (key == "memoryHigh") {
+            valid = inRange(value, 0, std::numeric_limits<qlonglong>::max());
+        } else if (key == "rootDir" || key == "adminDir") {
+            // rootDir 为空表示主机根目录，只单独指定了 adminDir
+            const QString path = value.toString();
+            if (value.userType() == QMetaType::QString && key == "rootDir" && path.isEmpty()) {
+                sanitized.insert(key, path);
+                continue;
+            }
+
+            const QFileInfo info(path);
+            valid = value.userType() == QMetaType::QString && info.isAbsolute() && info.isDir();
+            if (valid) {
+                sanitized.insert(key, info.canonicalFilePath());
+                continue;
+            }
+        } else {
+            errorString = QString("Unknown option: %1").arg(key);
+            return false;
+        }
+
+        if (!valid) {
+            errorString = QString("Invalid value for option %1").arg(key);
+            return false;
+        }
+        sanitized.insert(key, value);
+    }
+
+    return true;
+}
+
+InstallHelper::InstallHelper(const QDBusConnection &bus, bool requireAuthorization, int idleTimeout, QObject *parent)
+    : QObject(parent)
+    , m_bus(bus)
+    , m_requireAuthorization(requireAuthorization)
+    , m_scheduler(new InstallScheduler(this))
+    , m_idleTimer(new QTimer(this))
+    , m_currentJob(0)
+{
+    qDBusRegisterMetaType<PolkitSubject>();
+    qDBusRegisterMetaType<PolkitResult>();
+    qDBusRegisterMetaType<PolkitDetails>();
+
+    // 调度器的信号按发出顺序排队送到这里，jobStarted 与 jobFinished 之间的输出都属于当前任务
+    connect(m_scheduler, &InstallBackend::waitingForLock, this, &InstallHelper::onWaitingForLock);
+    connect(m_scheduler, &InstallBackend::jobStarted, this, &InstallHelper::onJobStarted);
+    connect(m_scheduler, &InstallBackend::jobFinished, this, &InstallHelper::onJobFinished);
+    connect(m_scheduler, &InstallBackend::message, this, [this](const QString &text) {
+        sendToOwner(m_currentJob, "Message", { m_currentJob, text });
+    });
+    connect(m_scheduler, &InstallBackend::output, this, [this](const QString &text) {
+        sendToOwner(m_currentJob, "Output", { m_currentJob, text });
+    });
+    connect(m_scheduler, &InstallBackend::progressChanged, this, [this](double percent, const QString &action) {
+        sendToOwner(m_currentJob, "ProgressChanged", { m_currentJob, percent, action });
+    });
+    connect(m_scheduler, &InstallBackend::conffilePrompt, this, [this](const QString &conffile) {
+        sendToOwner(m_currentJob, "ConffilePrompt", { m_currentJob, conffile });
+    });
+    connect(m_scheduler, &InstallBackend::debconfQuestions, this, [this](const QVariantList &questions) {
+        sendToOwner(m_currentJob, "DebconfQuestions", { m_currentJob, questions });
+    });
+
+    m_bus.connect("org.freedesktop.DBus", "/org/freedesktop/DBus", "org.freedesktop.DBus", "NameOwnerChanged",
+                  this, SLOT(onNameOwnerChanged(QString,QString,QString)));
+
+    // 每个任务结束后重新计时，空闲一段时间后退出
+    connect(m_scheduler, &InstallBackend::jobFinished, m_idleTimer, qOverload<>(&QTimer::start));
+
+    m_idleTimer->setSingleShot(true);
+    m_idleTimer->setInterval(idleTimeout * 1000);
+    connect(m_idleTimer, &QTimer::timeout, this, &InstallHelper::onIdleTimeout);
+    m_idleTimer->start();
+}
+
+int InstallHelper::Install(const QStringList &files, const QVariantMap &options)
+{
+    m_idleTimer->stop();
+
+    // 相对路径会按助手自己的工作目录解析
+    QVariantMap jobOptions;
+    QString errorString;
+    for (const QString &file : files) {
+        if (!QFileInfo(file).isAbsolute()) {
+            errorString = QString("Not an absolute path: %1").arg(file);
+        }
+    }
+    if (!errorString.isEmpty() || !sanitizeOptions(options, jobOptions, errorString)) {
+        sendErrorReply(QDBusError::InvalidArgs, errorString);
+        m_idleTimer->start();
+        return 0;
+    }
+
+    // 安装到其它根目录可以改写任意位置的文件，每次都重新认证，不使用缓存的授权
+    const TargetRoot root = TargetRoot::fromOptions(jobOptions);
+    const QString sender = message().service();
+    if (!m_requireAuthorization || (root.isHost() && m_authorizedClients.contains(sender))) {
+        const int id = m_scheduler->enqueue(files, jobOptions);
+        m_jobOwners.insert(id, sender);
+        return id;
+    }
+
+    // 等待 polkit 授权完成后再回复
+    setDelayedReply(true);
+    const QDBusMessage request = message();
+
+    PolkitDetails details;
+    QString action = InstallAction;
+    if (!root.isHost()) {
+        action = InstallRootAction;
+        details.insert("root", root.rootDir().isEmpty() ? QString("/") : root.rootDir());
+        details.insert("admindir", root.adminDir());
+    }
+
+    checkAuthorization(sender, action, details, [this, request, sender, files, jobOptions, root](bool authorized) {
+        if (!authorized) {
+            m_bus.send(request.createErrorReply(QDBusError::AccessDenied, tr("Not authorized to install packages")));
+            m_idleTimer->start();
+            return;
+        }
+
+        if (root.isHost()) {
+            m_authorizedClients.insert(sender);
+        }
+
+        // 先回复任务编号，任务会在下一次事件循环中才开始执行
+        const int id = m_scheduler->enqueue(files, jobOptions);
+        m_jobOwners.insert(id, sender);
+        m_bus.send(request.createReply(id));
+    });
+
+    return 0;
+}
+
+void InstallHelper::AnswerConffile(bool replace)
+{
+    if (isCurrentJobOwner()) {
+        m_scheduler->answerConffile(replace);
+    }
+}
+
+void InstallHelper::AnswerDebconf(const QVariantMap &values)
+{
+    if (isCurrentJobOwner()) {
+        m_scheduler->answerDebconf(values);
+    }
+}
+
+bool InstallHelper::isCurrentJobOwner()
+{
+    // 只有提交了正在执行的任务的客户端才能回答其中的问题
+    if (m_currentJob == 0 || m_jobOwners.value(m_currentJob) != message().service()) {
+        sendErrorReply(QDBusError::AccessDenied, tr("Not the owner of the running install"));
+        return false;
+    }
+    return true;
+}
+
+void InstallHelper::sendToOwner(int id, const QString &name, const QVariantList &arguments)
+{
+    const QString owner = m_jobOwners.value(id);
+    if (owner.isEmpty()) {
+        return;
+    }
+
+    QDBusMessage signal = QDBusMessage::createTargetedSignal(owner, HELPER_PATH, HELPER_INTERFACE, name);
+    signal.setArguments(arguments);
+    m_bus.send(signal);
+}
+
+void InstallHelper::onWaitingForLock(const QString &description)
+{
+    // 只通知还有任务在排队的客户端
+    const QList<QString> owners = m_jobOwners.values();
+    for (const QString &owner : QSet<QString>(owners.constBegin(), owners.constEnd())) {
+        QDBusMessage signal = QDBusMessage::createTargetedSignal(owner, HELPER_PATH, HELPER_INTERFACE, "WaitingForLock");
+        signal << description;
+        m_bus.send(signal);
+    }
+}
+
+void InstallHelper::onJobStarted(int id, const QStringList &files)
+{
+    m_currentJob = id;
+    sendToOwner(id, "JobStarted", { id, files });
+}
+
+void InstallHelper::onJobFinished(int id, bool success, const QString &errorString, const QStringList &summary,
+                                  const QVariantList &timings)
+{
+    sendToOwner(id, "JobFinished", { id, success, errorString, summary, timings });
+    m_jobOwners.remove(id);
+    m_currentJob = 0;
+}
+
+void InstallHelper::onNameOwnerChanged(const QString &name, const QString &oldOwner, const QString &newOwner)
+{
+    Q_UNUSED(oldOwner);
+
+    // 唯一总线名不会被重新使用，客户端断开后它的授权与任务的输出都不再需要
+    if (!name.startsWith(':') || !newOwner.isEmpty()) {
+        return;
+    }
+
+    // 正在安装的任务不再有人回答提示，使用默认值继续，避免 dpkg 一直持有锁
+    if (m_currentJob != 0 && m_jobOwners.value(m_currentJob) == name) {
+        m_scheduler->abandonPrompts();
+    }
+
+    m_authorizedClients.remove(name);
+    for (auto it = m_jobOwners.begin(); it != m_jobOwners.end();) {
+        if (it.value() == name) {
+            it = m_jobOwners.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void InstallHelper::checkAuthorization(const QString &sender, const QString &action, const QMap<QString, QString> &details,
+                                       std::function<void(bool)> callback)
+{
+    PolkitSubject subject;
+    subject.kind = "system-bus-name";
+    subject.details.insert("name", sender);
+
+    QDBusMessage call = QDBusMessage::createMethodCall("org.freedesktop.PolicyKit1",
+                                                       "/org/freedesktop/PolicyKit1/Authority",
+                                                       "org.freedesktop.PolicyKit1.Authority",
+                                                       "CheckAuthorization");
+    // flags = 1: AllowUserInteraction
+    call << QVariant::fromValue(subject)
+         << action
+         << QVariant::fromValue(details)
+         << uint(1)
+         << QString();
+
+    QDBusPendingCallWatcher *watcher = new QDBusPendingCallWatcher(QDBusConnection::systemBus().asyncCall(call, AuthorizationTimeout), this);
+    connect(watcher, &QDBusPendingCallWatcher::finished, this, [callback](QDBusPendingCallWatcher *watcher) {
+        QDBusPendingReply<PolkitResult> reply = *watcher;
+        if (reply.isError()) {
+            qWarning() << "Polkit authorization failed:" << reply.error().message();
+        }
+
+        callback(!reply.isError() && reply.value().isAuthorized);
+        watcher->deleteLater();
+    });
+}
+
+void InstallHelper::onIdleTimeout()
+{
+    if (m_scheduler->isBusy()) {
+        m_idleTimer->start();
+        return;
+    }
+
+    QCoreApplication::quit();
+}
@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2021 Cutefish Technology Co., Ltd.
+ *
+ * Author:     Reion Wong <reion@cutefishos.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef INSTALLHELPER_H
+#define INSTALLHELPER_H
+
+#include <QObject>
+#include <QHash>
+#include <QMap>
+#include <QSet>
+#include <QDBusConnection>
+#include <QDBusContext>
+#include <QDBusMessage>
+#include <QVariantMap>
+
+#include <functional>
+
+class QTimer;
+class InstallScheduler;
+
+class InstallHelper : public QObject, protected QDBusContext
+{
+    Q_OBJECT
+    Q_CLASSINFO("D-Bus Interface", "com.cutefish.DebInstaller.Helper")
+
+public:
+    InstallHelper(const QDBusConnection &bus, bool requireAuthorization, int idleTimeout, QObject *parent = nullptr);
+
+public slots:
+    int Install(const QStringList &files, const QVariantMap &options);
+    void AnswerConffile(bool replace);
+    void AnswerDebconf(const QVariantMap &values);
+
+    // 以下信号只用于内省，实际作为单播消息发给提交任务的客户端，其他客户端收不到
+signals:
+    void WaitingForLock(const QString &description);
+    void JobStarted(int id, const QStringList &files);
+    void JobFinished(int id, bool success, const QString &errorString, const QStringList &summary,
+                     const QVariantList &timings);
+    void Message(int id, const QString &text);
+    void Output(int id, const QString &text);
+    void ProgressChanged(int id, double percent, const QString &action);
+    void ConffilePrompt(int id, const QString &conffile);
+    void DebconfQuestions(int id, const QVariantList &questions);
+
+private slots:
+    void onIdleTimeout();
+    void onNameOwnerChanged(const QString &name, const QString &oldOwner, const QString &newOwner);
+
+    void onWaitingForLock(const QString &description);
+    void onJobStarted(int id, const QStringList &files);
+    void onJobFinished(int id, bool success, const QString &errorString, const QStringList &summary,
+                       const QVariantList &timings);
+
+private:
+    bool isCurrentJobOwner();
+    void sendToOwner(int id, const QString &name, const QVariantList &arguments);
+    void checkAuthorization(const QString &sender, const QString &action, const QMap<QString, QString> &details,
+                            std::function<void(bool)> callback);
+
+private:
+    QDBusConnection m_bus;
+    bool m_requireAuthorization;
+
+    InstallScheduler *m_scheduler;
+    QTimer *m_idleTimer;
+
+    // 已经授权安装到主机的客户端（唯一总线名），空闲期内不再重复认证，断开后移除
+    QSet<QString> m_authorizedClients;
+
+    // 任务编号 -> 提交任务的客户端，任务结束或客户端断开后移除
+    QHash<int, QString> m_jobOwners;
+    int m_currentJob;
+};
+
+#endif // INSTALLHELPER_H
@@ -0,0 +1,63 @@
+/*
+ * Copyright (C) 2021 Cutefish Technology Co., Ltd.
+ *
+ * Author:     Reion Wong <reion@cutefishos.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QDBusConnection>
+#include <QDebug>
+
+#include <apt-pkg/configuration.h>
+#include <apt-pkg/init.h>
+#include <apt-pkg/pkgsystem.h>
+
+#include "installhelper.h"
+#include "helperclient.h"
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    parser.addOption(QCommandLineOption("session", "Register on the session bus without polkit checks (for testing)"));
+    parser.addOption(QCommandLineOption("idle-timeout", "Exit after being idle for <seconds>", "seconds", "60"));
+    parser.process(app);
+
+    if (!pkgInitConfig(*_config) || !pkgInitSystem(*_config, _system)) {
+        qWarning() << "Failed to initialize APT";
+        return 1;
+    }
+
+    const bool session = parser.isSet("session");
+    QDBusConnection bus = session ? QDBusConnection::sessionBus() : QDBusConnection::systemBus();
+
+    InstallHelper helper(bus, !session, parser.value("idle-timeout").toInt());
+
+    if (!bus.registerObject(HELPER_PATH, &helper, QDBusConnection::ExportAllSlots | QDBusConnection::ExportAllSignals)) {
+        qWarning() << "Failed to register helper object";
+        return 1;
+    }
+
+    if (!bus.registerService(HELPER_SERVICE)) {
+        qWarning() << "Failed to register" << HELPER_SERVICE << bus.lastError().message();
+        return 1;
+    }
+
+    return app.exec();
+}
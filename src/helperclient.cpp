@@ -0,0 +1,175 @@
+/*
+ * Copyright (C) 2021 Cutefish Technology Co., Ltd.
+ *
+ * Author:     Reion Wong <reion@cutefishos.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "helperclient.h"
+#include <QDBusArgument>
+#include <QDBusMessage>
+#include <QDBusPendingCall>
+#include <QDBusPendingCallWatcher>
+#include <QDBusPendingReply>
+#include <QDebug>
+
+// 等待用户在 polkit 对话框中输入密码，超时时间需要足够长
+static const int AuthorizationTimeout = 5 * 60 * 1000;
+
+// av 中的每一项以 a{sv} 传输，收到时仍是未解包的 QDBusArgument
+static QVariantList demarshalMaps(const QVariantList &list)
+{
+    QVariantList result;
+    for (const QVariant &item : list) {
+        if (item.canConvert<QDBusArgument>()) {
+            result << qdbus_cast<QVariantMap>(item.value<QDBusArgument>());
+        } else {
+            result << item;
+        }
+    }
+    return result;
+}
+
+HelperClient::HelperClient(QObject *parent)
+    : InstallBackend(parent)
+    , m_bus(helperBus())
+    , m_nextId(1)
+    , m_waitingReplies(0)
+{
+    m_bus.connect(HELPER_SERVICE, HELPER_PATH, HELPER_INTERFACE, "WaitingForLock",
+                  this, SLOT(onWaitingForLock(QString)));
+    m_bus.connect(HELPER_SERVICE, HELPER_PATH, HELPER_INTERFACE, "JobStarted",
+                  this, SLOT(onJobStarted(int,QStringList)));
+    m_bus.connect(HELPER_SERVICE, HELPER_PATH, HELPER_INTERFACE, "JobFinished",
+                  this, SLOT(onJobFinished(int,bool,QString,QStringList,QVariantList)));
+    m_bus.connect(HELPER_SERVICE, HELPER_PATH, HELPER_INTERFACE, "Message",
+                  this, SLOT(onMessage(int,QString)));
+    m_bus.connect(HELPER_SERVICE, HELPER_PATH, HELPER_INTERFACE, "Output",
+                  this, SLOT(onOutput(int,QString)));
+    m_bus.connect(HELPER_SERVICE, HELPER_PATH, HELPER_INTERFACE, "ProgressChanged",
+                  this, SLOT(onProgressChanged(int,double,QString)));
+    m_bus.connect(HELPER_SERVICE, HELPER_PATH, HELPER_INTERFACE, "ConffilePrompt",
+                  this, SLOT(onConffilePrompt(int,QString)));
+    m_bus.connect(HELPER_SERVICE, HELPER_PATH, HELPER_INTERFACE, "DebconfQuestions",
+                  this, SLOT(onDebconfQuestions(int,QVariantList)));
+}
+
+QDBusConnection HelperClient::helperBus()
+{
+    if (qgetenv("CUTEFISH_DEBINSTALLER_HELPER_BUS") == "session") {
+        return QDBusConnection::sessionBus();
+    }
+    return QDBusConnection::systemBus();
+}
+
+int HelperClient::enqueue(const QStringList &files, const QVariantMap &options)
+{
+    const int localId = m_nextId++;
+
+    QDBusMessage call = QDBusMessage::createMethodCall(HELPER_SERVICE, HELPER_PATH, HELPER_INTERFACE, "Install");
+    call << files << options;
+
+    // 异步调用，授权对话框显示期间界面保持响应
+    QDBusPendingCallWatcher *watcher = new QDBusPendingCallWatcher(m_bus.asyncCall(call, AuthorizationTimeout), this);
+    ++m_waitingReplies;
+
+    connect(watcher, &QDBusPendingCallWatcher::finished, this, [this, localId](QDBusPendingCallWatcher *watcher) {
+        QDBusPendingReply<int> reply = *watcher;
+        --m_waitingReplies;
+
+        if (reply.isError()) {
+            emit jobFinished(localId, false, reply.error().message(), QStringList(), QVariantList());
+        } else {
+            m_jobs.insert(reply.value(), localId);
+        }
+
+        watcher->deleteLater();
+    });
+
+    return localId;
+}
+
+void HelperClient::answerConffile(bool replace)
+{
+    QDBusMessage call = QDBusMessage::createMethodCall(HELPER_SERVICE, HELPER_PATH, HELPER_INTERFACE, "AnswerConffile");
+    call << replace;
+    m_bus.asyncCall(call);
+}
+
+void HelperClient::answerDebconf(const QVariantMap &values)
+{
+    QDBusMessage call = QDBusMessage::createMethodCall(HELPER_SERVICE, HELPER_PATH, HELPER_INTERFACE, "AnswerDebconf");
+    call << values;
+    m_bus.asyncCall(call);
+}
+
+void HelperClient::onWaitingForLock(const QString &description)
+{
+    if (!m_jobs.isEmpty() || m_waitingReplies > 0) {
+        emit waitingForLock(description);
+    }
+}
+
+void HelperClient::onJobStarted(int id, const QStringList &files)
+{
+    // 助手同时服务多个客户端，只处理自己提交的任务
+    if (m_jobs.contains(id)) {
+        emit jobStarted(m_jobs.value(id), files);
+    }
+}
+
+void HelperClient::onJobFinished(int id, bool success, const QString &errorString, const QStringList &summary,
+                                 const QVariantList &timings)
+{
+    if (m_jobs.contains(id)) {
+        emit jobFinished(m_jobs.take(id), success, errorString, summary, demarshalMaps(timings));
+    }
+}
+
+void HelperClient::onMessage(int id, const QString &text)
+{
+    if (m_jobs.contains(id)) {
+        emit message(text);
+    }
+}
+
+void HelperClient::onOutput(int id, const QString &text)
+{
+    if (m_jobs.contains(id)) {
+        emit output(text);
+    }
+}
+
+void HelperClient::onProgressChanged(int id, double percent, const QString &action)
+{
+    if (m_jobs.contains(id)) {
+        emit progressChanged(percent, action);
+    }
+}
+
+void HelperClient::onConffilePrompt(int id, const QString &conffile)
+{
+    if (m_jobs.contains(id)) {
+        emit conffilePrompt(conffile);
+    }
+}
+
+void HelperClient::onDebconfQuestions(int id, const QVariantList &questions)
+{
+    if (!m_jobs.contains(id)) {
+        return;
+    }
+
+    emit debconfQuestions(demarshalMaps(questions));
+}
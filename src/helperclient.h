@@ -0,0 +1,66 @@
+/*
+ * Copyright (C) 2021 Cutefish Technology Co., Ltd.
+ *
+ * Author:     Reion Wong <reion@cutefishos.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef HELPERCLIENT_H
+#define HELPERCLIENT_H
+
+#include <QHash>
+#include <QDBusConnection>
+
+#include "installbackend.h"
+
+#define HELPER_SERVICE "com.cutefish.DebInstaller.Helper"
+#define HELPER_PATH "/"
+#define HELPER_INTERFACE "com.cutefish.DebInstaller.Helper"
+
+// 通过 D-Bus 把安装任务交给特权助手，界面进程本身不需要 root
+class HelperClient : public InstallBackend
+{
+    Q_OBJECT
+
+public:
+    explicit HelperClient(QObject *parent = nullptr);
+
+    int enqueue(const QStringList &files, const QVariantMap &options) override;
+    void answerConffile(bool replace) override;
+    void answerDebconf(const QVariantMap &values) override;
+
+    // 设置 CUTEFISH_DEBINSTALLER_HELPER_BUS=session 时使用会话总线上的替身
+    static QDBusConnection helperBus();
+
+private slots:
+    void onWaitingForLock(const QString &description);
+    void onJobStarted(int id, const QStringList &files);
+    void onJobFinished(int id, bool success, const QString &errorString, const QStringList &summary,
+                       const QVariantList &timings);
+    void onMessage(int id, const QString &text);
+    void onOutput(int id, const QString &text);
+    void onProgressChanged(int id, double percent, const QString &action);
+    void onConffilePrompt(int id, const QString &conffile);
+    void onDebconfQuestions(int id, const QVariantList &questions);
+
+private:
+    QDBusConnection m_bus;
+    int m_nextId;
+
+    // 助手的任务编号 -> 本地任务编号
+    QHash<int, int> m_jobs;
+    int m_waitingReplies;
+};
+
+#endif // HELPERCLIENT_H
@@ -0,0 +1,56 @@
+/*
+ * Copyright (C) 2021 Cutefish Technology Co., Ltd.
+ *
+ * Author:     Reion Wong <reion@cutefishos.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef INSTALLBACKEND_H
+#define INSTALLBACKEND_H
+
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QVariantMap>
+#include <QVariantList>
+
+// 安装任务的执行端：进程内的 InstallScheduler 或通过 D-Bus 的特权助手
+class InstallBackend : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit InstallBackend(QObject *parent = nullptr);
+
+    virtual int enqueue(const QStringList &files, const QVariantMap &options) = 0;
+
+    // 回答安装过程中的配置文件提示与 debconf 问题
+    virtual void answerConffile(bool replace) = 0;
+    virtual void answerDebconf(const QVariantMap &values) = 0;
+
+signals:
+    void waitingForLock(const QString &description);
+    void jobStarted(int id, const QStringList &files);
+    void jobFinished(int id, bool success, const QString &errorString, const QStringList &summary,
+                     const QVariantList &timings);
+
+    void message(const QString &text);
+    void output(const QString &text);
+    void progressChanged(double percent, const QString &action);
+
+    void conffilePrompt(const QString &conffile);
+    void debconfQuestions(const QVariantList &questions);
+};
+
+#endif // INSTALLBACKEND_H
@@ -0,0 +1,217 @@
+/*
+ * Copyright (C) 2021 Cutefish Technology Co., Ltd.
+ *
+ * Author:     Reion Wong <reion@cutefishos.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "installcgroup.h"
+#include <QDir>
+#include <QFile>
+#include <QLocale>
+#include <QMutex>
+
+#include <atomic>
+
+#include <sys/xattr.h>
+#include <unistd.h>
+
+namespace {
+
+const QString CgroupRoot = "/sys/fs/cgroup";
+
+QByteArray readFile(const QString &path)
+{
+    QFile file(path);
+    return file.open(QIODevice::ReadOnly) ? file.readAll() : QByteArray();
+}
+
+bool writeFile(const QString &path, const QByteArray &value)
+{
+    QFile file(path);
+    return file.open(QIODevice::WriteOnly) && file.write(value) == value.size();
+}
+
+// cpu.stat、memory.events 等文件每行为 "<键> <值>"
+qint64 keyedValue(const QByteArray &data, const QByteArray &key)
+{
+    for (const QByteArray &line : data.split('\n')) {
+        const QList<QByteArray> fields = line.split(' ');
+        if (fields.size() == 2 && fields.first() == key) {
+            return fields.last().toLongLong();
+        }
+    }
+    return 0;
+}
+
+}
+
+QString InstallCgroup::delegatedBase()
+{
+    static QMutex mutex;
+    static bool prepared = false;
+    static QString base;
+
+    QMutexLocker locker(&mutex);
+    if (prepared) {
+        return base;
+    }
+    prepared = true;
+
+    // 只支持统一层级（cgroup v2），/proc/self/cgroup 中只有 "0::<路径>" 一行
+    QString path;
+    for (const QByteArray &line : readFile("/proc/self/cgroup").split('\n')) {
+        if (line.startsWith("0::")) {
+            path = QString::fromUtf8(line.mid(3));
+        }
+    }
+    if (path.isEmpty() || path == "/") {
+        return base;
+    }
+
+    // systemd 在被委派的 cgroup 上设置 trusted.delegate，没有委派时不能在其下创建子组
+    const QString candidate = CgroupRoot + path;
+    char delegate = 0;
+    if (::getxattr(QFile::encodeName(candidate).constData(), "trusted.delegate", &delegate, 1) != 1 || delegate != '1') {
+        return base;
+    }
+
+    // 有子组时进程不能留在父组中，先把自己移到 main 子组，再为子组启用控制器
+    const QString main = candidate + "/main";
+    if (!QDir().mkpath(main) || !writeFile(main + "/cgroup.procs", "0")) {
+        return base;
+    }
+
+    const QList<QByteArray> available = readFile(candidate + "/cgroup.controllers").trimmed().split(' ');
+    for (const QByteArray &controller : { QByteArray("cpu"), QByteArray("io"), QByteArray("memory") }) {
+        if (available.contains(controller)) {
+            writeFile(candidate + "/cgroup.subtree_control", "+" + controller);
+        }
+    }
+
+    base = candidate;
+    return base;
+}
+
+InstallCgroup::InstallCgroup()
+{
+}
+
+InstallCgroup::~InstallCgroup()
+{
+    remove();
+}
+
+bool InstallCgroup::create(const Limits &limits)
+{
+    const QString base = delegatedBase();
+    if (base.isEmpty()) {
+        return false;
+    }
+
+    static std::atomic<int> counter(0);
+    const QString path = QString("%1/install-%2").arg(base).arg(++counter);
+    if (!QDir().mkdir(path)) {
+        return false;
+    }
+
+    m_path = path;
+
+    // 控制器不可用（例如没有 io.weight）时这些文件不存在，跳过即可
+    if (limits.cpuWeight > 0) {
+        writeFile(m_path + "/cpu.weight", QByteArray::number(limits.cpuWeight));
+    }
+    if (limits.ioWeight > 0) {
+        writeFile(m_path + "/io.weight", "default " + QByteArray::number(limits.ioWeight));
+    }
+    if (limits.memoryHigh > 0) {
+        writeFile(m_path + "/memory.high", QByteArray::number(limits.memoryHigh));
+    }
+
+    return true;
+}
+
+bool InstallCgroup::isValid() const
+{
+    return !m_path.isEmpty();
+}
+
+QString InstallCgroup::path() const
+{
+    return m_path;
+}
+
+InstallCgroup::Usage InstallCgroup::usage() const
+{
+    Usage usage;
+    if (!isValid()) {
+        return usage;
+    }
+
+    const QByteArray cpuStat = readFile(m_path + "/cpu.stat");
+    usage.cpuUsec = keyedValue(cpuStat, "usage_usec");
+    usage.userUsec = keyedValue(cpuStat, "user_usec");
+    usage.systemUsec = keyedValue(cpuStat, "system_usec");
+
+    // io.stat 每个设备一行："<主:次> rbytes=... wbytes=... rios=... ..."
+    for (const QByteArray &line : readFile(m_path + "/io.stat").split('\n')) {
+        for (const QByteArray &field : line.split(' ')) {
+            if (field.startsWith("rbytes=")) {
+                usage.readBytes += field.mid(7).toLongLong();
+            } else if (field.startsWith("wbytes=")) {
+                usage.writeBytes += field.mid(7).toLongLong();
+            }
+        }
+    }
+
+    const QByteArray peak = readFile(m_path + "/memory.peak").trimmed();
+    if (!peak.isEmpty()) {
+        usage.memoryPeak = peak.toLongLong();
+    }
+    usage.memoryHighEvents = keyedValue(readFile(m_path + "/memory.events"), "high");
+
+    return usage;
+}
+
+QString InstallCgroup::usageSummary() const
+{
+    const Usage usage = this->usage();
+    const QLocale locale;
+
+    QString summary = tr("Install processes used %1 s CPU (user %2 s, system %3 s), read %4, wrote %5")
+            .arg(usage.cpuUsec / 1e6, 0, 'f', 1)
+            .arg(usage.userUsec / 1e6, 0, 'f', 1)
+            .arg(usage.systemUsec / 1e6, 0, 'f', 1)
+            .arg(locale.formattedDataSize(usage.readBytes), locale.formattedDataSize(usage.writeBytes));
+
+    if (usage.memoryPeak >= 0) {
+        summary += tr(", peak memory %1").arg(locale.formattedDataSize(usage.memoryPeak));
+    }
+    if (usage.memoryHighEvents > 0) {
+        summary += tr(", throttled %n time(s) at memory.high", "", usage.memoryHighEvents);
+    }
+
+    return summary;
+}
+
+void InstallCgroup::remove()
+{
+    if (m_path.isEmpty()) {
+        return;
+    }
+
+    // postinst 启动的后台进程可能仍在其中，此时 rmdir 返回 EBUSY
+    ::rmdir(QFile::encodeName(m_path).constData());
+    m_path.clear();
+}
@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) 2021 Cutefish Technology Co., Ltd.
+ *
+ * Author:     Reion Wong <reion@cutefishos.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef INSTALLCGROUP_H
+#define INSTALLCGROUP_H
+
+#include <QString>
+#include <QByteArray>
+#include <QCoreApplication>
+
+// dpkg 子进程（包括维护脚本与 DKMS 编译）所在的临时 cgroup v2。
+// 建在助手服务自己的 cgroup 之下，需要 systemd 以 Delegate=yes 委派，不触碰 systemd 管理的其它部分；
+// 由 dpkg 启动器在 exec 之前把自己移入 path()，创建它的进程不在其中；结束时统计 CPU、IO 与内存用量
+class InstallCgroup
+{
+    Q_DECLARE_TR_FUNCTIONS(InstallCgroup)
+
+public:
+    struct Limits {
+        int cpuWeight = 0;       // cpu.weight，1 到 10000，相对于服务中的其它进程；服务整体的权重由 systemd 单元设置；0 表示不设置
+        int ioWeight = 0;        // io.weight，同上
+        qint64 memoryHigh = 0;   // memory.high 字节数，超过后被回收与限速；0 表示不限制
+    };
+
+    struct Usage {
+        qint64 cpuUsec = 0;
+        qint64 userUsec = 0;
+        qint64 systemUsec = 0;
+        qint64 readBytes = 0;
+        qint64 writeBytes = 0;
+        qint64 memoryPeak = -1;        // 内核不支持 memory.peak 时为 -1
+        qint64 memoryHighEvents = 0;   // 达到 memory.high 的次数
+    };
+
+    InstallCgroup();
+    ~InstallCgroup();
+
+    // 需要 cgroup v2 与被委派的服务 cgroup；失败时不影响安装，只是不做限制
+    bool create(const Limits &limits);
+    bool isValid() const;
+    QString path() const;
+
+    Usage usage() const;
+    QString usageSummary() const;
+
+    // 子进程全部退出后才能删除；仍有残留进程时保留目录
+    void remove();
+
+private:
+    // 本进程被委派的 cgroup；首次使用时把进程移到其下的 main 子组并启用控制器
+    static QString delegatedBase();
+
+    QString m_path;
+};
+
+#endif // INSTALLCGROUP_H
@@ -0,0 +1,246 @@
+/*
+ * Copyright (C) 2021 Cutefish Technology Co., Ltd.
+ *
+ * Author:     Reion Wong <reion@cutefishos.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "installedfiles.h"
+#include "debarchive.h"
+#include "dpkgstatuswatcher.h"
+#include "iopriority.h"
+#include <QCryptographicHash>
+#include <QFile>
+#include <QHash>
+#include <QSet>
+#include <QThread>
+#include <QMutex>
+
+#include <atomic>
+#include <vector>
+
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+
+namespace {
+
+// md5sums 每行为 "<md5>  <相对路径>"
+QHash<QString, QByteArray> parseMd5sums(const QByteArray &data)
+{
+    QHash<QString, QByteArray> sums;
+    for (const QByteArray &line : data.split('\n')) {
+        const int pos = line.indexOf("  ");
+        if (pos == 32) {
+            sums.insert("/" + QString::fromUtf8(line.mid(pos + 2)), line.left(pos).toLower());
+        }
+    }
+    return sums;
+}
+
+// 被其它包或本地管理员转移的文件不在原路径上，不能比较也不能覆盖
+QSet<QString> divertedFiles(const QString &adminDir, const QString &package)
+{
+    QSet<QString> files;
+    QFile file(adminDir + "/diversions");
+    if (!file.open(QIODevice::ReadOnly)) {
+        return files;
+    }
+
+    // 每条记录三行：原路径、转移后的路径、执行转移的包（本地转移为 ":"）
+    const QList<QByteArray> lines = file.readAll().split('\n');
+    for (int i = 0; i + 2 < lines.size(); i += 3) {
+        if (QString::fromUtf8(lines.at(i + 2)) != package) {
+            files.insert(QString::fromUtf8(lines.at(i)));
+        }
+    }
+    return files;
+}
+
+QByteArray md5sum(const QString &path)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return QByteArray();
+    }
+
+    QCryptographicHash hash(QCryptographicHash::Md5);
+    hash.addData(&file);
+    return hash.result().toHex();
+}
+
+QByteArray readSysfs(const QString &path)
+{
+    QFile file(path);
+    return file.open(QIODevice::ReadOnly) ? file.readAll().trimmed() : QByteArray();
+}
+
+// 要计算校验和的一个已安装文件，package 为它在 compareAll() 结果中的下标
+struct HashItem {
+    int package;
+    QString path;
+    QByteArray expected;
+};
+
+// 各线程从共享的下标中领取下一个文件，先完成的线程自然多处理，
+// 大文件不会拖住某一个线程预先分到的整段任务；多个包的文件在同一个队列中
+QList<QStringList> mismatchedFiles(const TargetRoot &root, const QList<HashItem> &items, int packageCount)
+{
+    std::atomic<int> next(0);
+    QMutex mutex;
+    QList<QStringList> mismatched(packageCount);
+
+    auto worker = [&]() {
+        // 低 CPU 与 IO 优先级，校验期间桌面保持响应
+        IoPriority::set(IoPriority::BestEffort, 7);
+
+        int i;
+        while ((i = next++) < items.size()) {
+            const HashItem &item = items.at(i);
+            if (md5sum(root.path(item.path)) != item.expected) {
+                QMutexLocker locker(&mutex);
+                mismatched[item.package] << item.path;
+            }
+        }
+    };
+
+    const int threadCount = qMin<int>(items.size(), InstalledFiles::hashThreadCount(root.path("/usr")));
+    std::vector<QThread *> threads;
+    for (int i = 0; i < threadCount; ++i) {
+        threads.push_back(QThread::create(worker));
+        threads.back()->start(QThread::LowPriority);
+    }
+
+    for (QThread *thread : threads) {
+        thread->wait();
+        delete thread;
+    }
+
+    for (QStringList &files : mismatched) {
+        files.sort();
+    }
+    return mismatched;
+}
+
+// 读取包的控制信息并与 dpkg 数据库对照，需要计算校验和时把文件加入 items
+void prepare(const QString &debFile, const TargetRoot &root, const DpkgStatusWatcher::Snapshot &status,
+             int index, InstalledFiles::Comparison &result, QList<HashItem> &items)
+{
+    const QString adminDir = root.adminDir();
+
+    const QByteArray control = DebArchive::controlMember(debFile, "control");
+    const QString package = DebArchive::controlField(control, "Package");
+    const QString version = DebArchive::controlField(control, "Version");
+    const QString arch = DebArchive::controlField(control, "Architecture");
+    result.package = package;
+
+    const DpkgStatusWatcher::PackageState state = status.value(package);
+    if (package.isEmpty() || !state.isInstalled() || state.version != version) {
+        result.state = InstalledFiles::Comparison::NotInstalled;
+        return;
+    }
+
+    // Multi-Arch: same 的包以 "<包名>:<架构>" 命名
+    QFile installedSums(QString("%1/info/%2:%3.md5sums").arg(adminDir, package, arch));
+    if (!installedSums.exists()) {
+        installedSums.setFileName(QString("%1/info/%2.md5sums").arg(adminDir, package));
+    }
+
+    bool ok = false;
+    const QByteArray packageSums = DebArchive::controlMember(debFile, "md5sums", &ok);
+    if (!ok || !installedSums.open(QIODevice::ReadOnly)) {
+        return;
+    }
+
+    // 同一版本号但重新构建过的包，只恢复文件是不够的
+    const QHash<QString, QByteArray> expected = parseMd5sums(packageSums);
+    if (expected.isEmpty() || expected != parseMd5sums(installedSums.readAll())) {
+        return;
+    }
+
+    // 配置文件可能按策略保留了本地修改，不参与比较
+    QSet<QString> skipped = divertedFiles(adminDir, package);
+    for (const QByteArray &line : DebArchive::controlMember(debFile, "conffiles").split('\n')) {
+        // 新版 dpkg 允许在路径前加 "remove-on-upgrade" 等标记
+        if (!line.trimmed().isEmpty()) {
+            skipped.insert(QString::fromUtf8(line.trimmed().split(' ').last()));
+        }
+    }
+
+    for (auto it = expected.constBegin(); it != expected.constEnd(); ++it) {
+        if (!skipped.contains(it.key())) {
+            items << HashItem { index, it.key(), it.value() };
+            ++result.checkedFiles;
+        }
+    }
+
+    // 先假定一致，计算校验和之后再改为 Modified
+    result.state = InstalledFiles::Comparison::Unchanged;
+}
+
+}
+
+InstalledFiles::Comparison InstalledFiles::compare(const QString &debFile, const TargetRoot &root)
+{
+    return compareAll(QStringList() << debFile, root).first();
+}
+
+QList<InstalledFiles::Comparison> InstalledFiles::compareAll(const QStringList &debFiles, const TargetRoot &root)
+{
+    const DpkgStatusWatcher::Snapshot status = DpkgStatusWatcher::parseStatusFile(root.adminDir() + "/status");
+
+    QList<Comparison> results(debFiles.size());
+    QList<HashItem> items;
+    for (int i = 0; i < debFiles.size(); ++i) {
+        prepare(debFiles.at(i), root, status, i, results[i], items);
+    }
+
+    const QList<QStringList> mismatched = mismatchedFiles(root, items, debFiles.size());
+    for (int i = 0; i < results.size(); ++i) {
+        if (!mismatched.at(i).isEmpty()) {
+            results[i].changedFiles = mismatched.at(i);
+            results[i].state = Comparison::Modified;
+        }
+    }
+
+    return results;
+}
+
+int InstalledFiles::hashThreadCount(const QString &path)
+{
+    int threads = QThread::idealThreadCount();
+
+    struct stat st;
+    if (::stat(QFile::encodeName(path).constData(), &st) != 0) {
+        return threads;
+    }
+
+    // 分区没有自己的 queue 目录，使用所在磁盘的
+    const QString device = QString("/sys/dev/block/%1:%2").arg(major(st.st_dev)).arg(minor(st.st_dev));
+    QString queue = device + "/queue";
+    if (!QFile::exists(queue)) {
+        queue = device + "/../queue";
+    }
+
+    if (readSysfs(queue + "/rotational") == "1") {
+        // 机械硬盘上并发读取只会增加寻道
+        return qMin(threads, 2);
+    }
+
+    const int depth = readSysfs(queue + "/nr_requests").toInt();
+    if (depth > 0) {
+        threads = qMin(threads, depth);
+    }
+
+    return qMax(1, threads);
+}
@@ -0,0 +1,56 @@
+/*
+ * Copyright (C) 2021 Cutefish Technology Co., Ltd.
+ *
+ * Author:     Reion Wong <reion@cutefishos.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef INSTALLEDFILES_H
+#define INSTALLEDFILES_H
+
+#include <QList>
+#include <QString>
+#include <QStringList>
+
+#include "targetroot.h"
+
+// 重新安装同一版本前，比较 deb 的 md5sums 与已安装文件，
+// 完全一致时无需运行 dpkg，只有少数文件被改动时只恢复这些文件
+class InstalledFiles
+{
+public:
+    struct Comparison {
+        enum State {
+            NotInstalled,    // 未安装或安装的是其它版本
+            NotComparable,   // 缺少 md5sums，或同一版本的包内容不同
+            Unchanged,
+            Modified,
+        };
+
+        State state = NotComparable;
+        QString package;
+        QStringList changedFiles;   // 内容不同或缺失的文件，以 / 开头
+        int checkedFiles = 0;
+    };
+
+    // 阻塞调用，也用于安装后的完整性校验（此时只有 Unchanged 表示校验通过）
+    static Comparison compare(const QString &debFile, const TargetRoot &root = TargetRoot());
+    // 多个包的文件放进同一个工作队列，结果与 debFiles 一一对应
+    static QList<Comparison> compareAll(const QStringList &debFiles, const TargetRoot &root = TargetRoot());
+
+    // 计算校验和的线程数：不超过 CPU 核数与 path 所在设备的请求队列深度，机械硬盘最多两个
+    static int hashThreadCount(const QString &path);
+};
+
+#endif // INSTALLEDFILES_H
@@ -0,0 +1,312 @@
+/*
+ * Copyright (C) 2021 Cutefish Technology Co., Ltd.
+ *
+ * Author:     Reion Wong <reion@cutefishos.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "installscheduler.h"
+#include "packagetransaction.h"
+#include "debconffrontend.h"
+#include <QTimer>
+#include <QFile>
+#include <QDebug>
+#include <QtConcurrent/QtConcurrent>
+
+#include <apt-pkg/error.h>
+#include <apt-pkg/pkgsystem.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace {
+
+const int InitialBackoff = 1000;
+const int MaximumBackoff = 30000;
+
+QString formatDuration(qint64 seconds)
+{
+    if (seconds < 60) {
+        return InstallScheduler::tr("%1 s").arg(seconds);
+    }
+    return InstallScheduler::tr("%1 min %2 s").arg(seconds / 60).arg(seconds % 60);
+}
+
+// 进程已运行的秒数，来自 /proc/<pid>/stat 的 starttime 字段
+qint64 processRunningSeconds(qint64 pid)
+{
+    QFile statFile(QString("/proc/%1/stat").arg(pid));
+    QFile uptimeFile("/proc/uptime");
+    if (!statFile.open(QIODevice::ReadOnly) || !uptimeFile.open(QIODevice::ReadOnly)) {
+        return 0;
+    }
+
+    // comm 字段可能包含空格，从最后一个 ')' 之后开始按空格拆分
+    const QByteArray stat = statFile.readAll();
+    const QList<QByteArray> fields = stat.mid(stat.lastIndexOf(')') + 2).split(' ');
+    if (fields.size() < 20) {
+        return 0;
+    }
+
+    const double startTime = fields.at(19).toDouble() / ::sysconf(_SC_CLK_TCK);
+    const double uptime = uptimeFile.readAll().split(' ').first().toDouble();
+    return qMax<qint64>(0, uptime - startTime);
+}
+
+}
+
+InstallScheduler::InstallScheduler(QObject *parent)
+    : InstallBackend(parent)
+    , m_nextId(1)
+    , m_running(false)
+    , m_current(nullptr)
+    , m_debconf(new DebconfFrontend(this))
+    , m_retryTimer(new QTimer(this))
+    , m_backoff(InitialBackoff)
+{
+    m_retryTimer->setSingleShot(true);
+    connect(m_retryTimer, &QTimer::timeout, this, &InstallScheduler::tryStart);
+
+    // 监听失败时维护脚本退回 noninteractive 前端，同样不会卡住
+    m_debconf->listen();
+    connect(m_debconf, &DebconfFrontend::questionsReady, this, &InstallScheduler::debconfQuestions);
+}
+
+int InstallScheduler::enqueue(const QStringList &files, const QVariantMap &options)
+{
+    QMutexLocker locker(&m_mutex);
+
+    Job job;
+    job.id = m_nextId++;
+    job.files = files;
+    job.options = options;
+    job.root = TargetRoot::fromOptions(options);
+    m_jobs << job;
+
+    // 正在持锁执行时，新任务会在同一次持锁期间接着执行
+    if (!m_running && !m_retryTimer->isActive()) {
+        QMetaObject::invokeMethod(this, &InstallScheduler::tryStart, Qt::QueuedConnection);
+    }
+
+    return job.id;
+}
+
+void InstallScheduler::answerConffile(bool replace)
+{
+    QMutexLocker locker(&m_mutex);
+    if (m_current) {
+        m_current->answerConffilePrompt(replace);
+    }
+}
+
+void InstallScheduler::answerDebconf(const QVariantMap &values)
+{
+    m_debconf->answer(values);
+}
+
+void InstallScheduler::abandonPrompts()
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        if (m_current) {
+            m_current->abandonPrompts();
+        }
+    }
+
+    m_debconf->setInteractive(false);
+    m_debconf->answer(QVariantMap());
+}
+
+bool InstallScheduler::isBusy() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_running || !m_jobs.isEmpty();
+}
+
+bool InstallScheduler::lockHolder(const TargetRoot &root, LockHolder &holder)
+{
+    // dpkg 与 APT 都使用 fcntl 记录锁，F_GETLK 可以查询持有者而不抢锁
+    const QStringList lockFiles = { root.adminDir() + "/lock-frontend", root.adminDir() + "/lock" };
+
+    for (const QString &lockFile : lockFiles) {
+        int fd = ::open(QFile::encodeName(lockFile).constData(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            continue;
+        }
+
+        struct flock fl = {};
+        fl.l_type = F_WRLCK;
+        fl.l_whence = SEEK_SET;
+        bool locked = ::fcntl(fd, F_GETLK, &fl) == 0 && fl.l_type != F_UNLCK;
+        ::close(fd);
+
+        if (locked) {
+            holder.pid = fl.l_pid;
+
+            QFile comm(QString("/proc/%1/comm").arg(fl.l_pid));
+            if (comm.open(QIODevice::ReadOnly)) {
+                holder.name = QString::fromUtf8(comm.readAll()).trimmed();
+            }
+            if (holder.name.isEmpty()) {
+                holder.name = tr("another package manager");
+            }
+
+            holder.runningSeconds = processRunningSeconds(fl.l_pid);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void InstallScheduler::tryStart()
+{
+    TargetRoot root;
+    {
+        QMutexLocker locker(&m_mutex);
+        if (m_running || m_jobs.isEmpty()) {
+            return;
+        }
+        root = m_jobs.first().root;
+    }
+
+    // 启动任何进程之前先检查锁，被占用则排队等待
+    LockHolder holder;
+    if (lockHolder(root, holder)) {
+        scheduleRetry(holder);
+        return;
+    }
+
+    m_backoff = InitialBackoff;
+    m_waitTimer.invalidate();
+
+    {
+        QMutexLocker locker(&m_mutex);
+        m_running = true;
+    }
+
+    QtConcurrent::run([this, root]() {
+        runJobs(root);
+    });
+}
+
+void InstallScheduler::scheduleRetry(const LockHolder &holder)
+{
+    if (!m_waitTimer.isValid()) {
+        m_waitTimer.start();
+    }
+
+    emit waitingForLock(tr("Waiting for %1 (pid %2, running for %3) to release the package database, waited %4")
+                        .arg(holder.name)
+                        .arg(holder.pid)
+                        .arg(formatDuration(holder.runningSeconds))
+                        .arg(formatDuration(m_waitTimer.elapsed() / 1000)));
+
+    m_retryTimer->start(m_backoff);
+    m_backoff = qMin(m_backoff * 2, MaximumBackoff);
+}
+
+bool InstallScheduler::takeJob(const TargetRoot &root, Job &job)
+{
+    QMutexLocker locker(&m_mutex);
+
+    for (int i = 0; i < m_jobs.size(); ++i) {
+        if (m_jobs.at(i).root == root) {
+            job = m_jobs.takeAt(i);
+            return true;
+        }
+    }
+
+    // 释放锁与清除运行标记需要在同一临界区内完成
+    _system->UnLock();
+    m_running = false;
+
+    // 剩下的任务属于其它目标，换一把锁继续
+    if (!m_jobs.isEmpty()) {
+        QMetaObject::invokeMethod(this, &InstallScheduler::tryStart, Qt::QueuedConnection);
+    }
+    return false;
+}
+
+void InstallScheduler::runJobs(const TargetRoot &root)
+{
+    // _system 的锁一直持有到这一批任务结束；APT 配置只在加锁、求解时切换到该目标，
+    // 提交时事务固定自己的配置，期间其它目标的分析不必等待整批任务
+    bool locked;
+    {
+        TargetRoot::Scope scope(root);
+        locked = _system->Lock();
+    }
+
+    // 检查与加锁之间可能被其它进程抢先，此时继续退避等待
+    if (!locked) {
+        _error->Discard();
+
+        {
+            QMutexLocker locker(&m_mutex);
+            m_running = false;
+        }
+
+        QMetaObject::invokeMethod(this, [this, root]() {
+            LockHolder holder;
+            if (!lockHolder(root, holder)) {
+                holder.name = tr("another package manager");
+            }
+            scheduleRetry(holder);
+        }, Qt::QueuedConnection);
+        return;
+    }
+
+    // 在同一次持锁期间连续执行队列中的任务
+    Job job;
+    while (takeJob(root, job)) {
+        emit jobStarted(job.id, job.files);
+
+        // debconfPolicy: "ask" 时把问题交给界面，否则使用预置的默认值
+        QVariantMap options = job.options;
+        options.insert("debconfSocket", m_debconf->socketPath());
+        m_debconf->setInteractive(options.value("debconfPolicy").toString() == "ask");
+
+        PackageTransaction transaction;
+        transaction.setOptions(options);
+        connect(&transaction, &PackageTransaction::message, this, &InstallScheduler::message);
+        connect(&transaction, &PackageTransaction::output, this, &InstallScheduler::output);
+        connect(&transaction, &PackageTransaction::progressChanged, this, &InstallScheduler::progressChanged);
+        connect(&transaction, &PackageTransaction::conffilePrompt, this, &InstallScheduler::conffilePrompt);
+
+        {
+            QMutexLocker locker(&m_mutex);
+            m_current = &transaction;
+        }
+
+        // repair: 已安装同一版本时只恢复被改动的文件
+        bool success;
+        if (options.value("repair").toBool()) {
+            success = transaction.repair(job.files.value(0));
+        } else {
+            {
+                TargetRoot::Scope scope(root);
+                success = transaction.resolve(job.files);
+            }
+            success = success && transaction.commit();
+        }
+
+        {
+            QMutexLocker locker(&m_mutex);
+            m_current = nullptr;
+        }
+
+        emit jobFinished(job.id, success, transaction.errorString(), transaction.summary(), transaction.timings());
+    }
+}
@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2021 Cutefish Technology Co., Ltd.
+ *
+ * Author:     Reion Wong <reion@cutefishos.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef INSTALLSCHEDULER_H
+#define INSTALLSCHEDULER_H
+
+#include <QString>
+#include <QStringList>
+#include <QList>
+#include <QMutex>
+#include <QElapsedTimer>
+
+#include "installbackend.h"
+#include "targetroot.h"
+
+class QTimer;
+class DebconfFrontend;
+class PackageTransaction;
+
+// 安装任务队列：dpkg 锁被占用时退避等待，拿到锁后在一次持锁期间连续执行所有任务；
+// 安装到不同根目录的任务按目标分批，每批持有该目标自己的 dpkg 锁
+class InstallScheduler : public InstallBackend
+{
+    Q_OBJECT
+
+public:
+    struct LockHolder {
+        qint64 pid = 0;
+        QString name;
+        qint64 runningSeconds = 0;
+    };
+
+    explicit InstallScheduler(QObject *parent = nullptr);
+
+    int enqueue(const QStringList &files, const QVariantMap &options) override;
+    void answerConffile(bool replace) override;
+    void answerDebconf(const QVariantMap &values) override;
+    bool isBusy() const;
+
+    // 正在执行的任务的提交者已经断开：等待中的提示使用默认值回答，之后不再提问
+    void abandonPrompts();
+
+    // 其它进程持有目标的 dpkg 锁时返回 true 并填写持有者信息
+    static bool lockHolder(const TargetRoot &root, LockHolder &holder);
+
+private slots:
+    void tryStart();
+
+private:
+    struct Job {
+        int id;
+        QStringList files;
+        QVariantMap options;
+        TargetRoot root;
+    };
+
+    void scheduleRetry(const LockHolder &holder);
+    void runJobs(const TargetRoot &root);
+    bool takeJob(const TargetRoot &root, Job &job);
+
+private:
+    mutable QMutex m_mutex;
+    QList<Job> m_jobs;
+    int m_nextId;
+    bool m_running;
+    PackageTransaction *m_current;
+
+    DebconfFrontend *m_debconf;
+
+    QTimer *m_retryTimer;
+    int m_backoff;
+    QElapsedTimer m_waitTimer;
+};
+
+#endif // INSTALLSCHEDULER_H
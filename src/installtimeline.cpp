@@ -0,0 +1,115 @@
+/*
+ * Copyright (C) 2021 Cutefish Technology Co., Ltd.
+ *
+ * Author:     Reion Wong <reion@cutefishos.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "installtimeline.h"
+#include <QVariantMap>
+
+InstallTimeline::InstallTimeline()
+    : m_start(-1)
+{
+}
+
+void InstallTimeline::addEvent(const DpkgStatusParser::Event &event)
+{
+    const QString package = event.package.section(':', 0, 0);
+
+    switch (event.type) {
+    case DpkgStatusParser::Event::Processing:
+        if (event.value == "install" || event.value == "upgrade" || event.value == "unpack") {
+            begin(package, "unpack", event.timestamp);
+        } else if (event.value == "configure") {
+            begin(package, "configure", event.timestamp);
+        } else if (event.value == "trigproc") {
+            begin(package, "trigger", event.timestamp);
+        } else {
+            begin(package, "remove", event.timestamp);
+        }
+        break;
+    case DpkgStatusParser::Event::Status:
+        if (event.value == "half-installed") {
+            begin(package, "unpack", event.timestamp);
+        } else if (event.value == "half-configured") {
+            // 处理触发器时 dpkg 同样会把包置为 half-configured
+            if (m_phase != "trigger" || m_package != package) {
+                begin(package, "postinst", event.timestamp);
+            }
+        } else {
+            begin(QString(), "dpkg", event.timestamp);
+        }
+        break;
+    case DpkgStatusParser::Event::ConffilePrompt:
+        // 事件中的是配置文件路径，等待时间仍归属当前正在配置的包
+        begin(m_package, "prompt", event.timestamp);
+        break;
+    case DpkgStatusParser::Event::Error:
+        begin(QString(), "dpkg", event.timestamp);
+        break;
+    }
+}
+
+void InstallTimeline::finish(qint64 timestamp)
+{
+    begin(QString(), QString(), timestamp);
+}
+
+void InstallTimeline::begin(const QString &package, const QString &phase, qint64 timestamp)
+{
+    // 同一阶段内的状态变化（如 unpack 中的 half-installed）不拆分
+    if (m_start >= 0 && package == m_package && phase == m_phase) {
+        return;
+    }
+
+    // 第一条事件之前是 dpkg 的启动时间
+    const qint64 start = m_start >= 0 ? m_start : 0;
+    const QString previousPackage = m_start >= 0 ? m_package : QString();
+    const QString previousPhase = m_start >= 0 ? m_phase : QString("dpkg");
+
+    const QString key = previousPackage + '\n' + previousPhase;
+    auto it = m_index.constFind(key);
+    if (it == m_index.constEnd()) {
+        it = m_index.insert(key, m_entries.size());
+        m_entries << Entry { previousPackage, previousPhase, 0, 0 };
+    }
+
+    Entry &entry = m_entries[it.value()];
+    entry.duration += timestamp - start;
+    entry.runs += 1;
+
+    m_package = package;
+    m_phase = phase;
+    m_start = phase.isEmpty() ? -1 : timestamp;
+}
+
+QList<InstallTimeline::Entry> InstallTimeline::entries() const
+{
+    return m_entries;
+}
+
+QVariantList InstallTimeline::toVariantList() const
+{
+    QVariantList list;
+    for (const Entry &entry : m_entries) {
+        QVariantMap map;
+        map["package"] = entry.package;
+        map["phase"] = entry.phase;
+        map["duration"] = entry.duration;
+        map["runs"] = entry.runs;
+        list << map;
+    }
+    return list;
+}
@@ -0,0 +1,69 @@
+/*
+ * Copyright (C) 2021 Cutefish Technology Co., Ltd.
+ *
+ * Author:     Reion Wong <reion@cutefishos.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef INSTALLTIMELINE_H
+#define INSTALLTIMELINE_H
+
+#include <QString>
+#include <QList>
+#include <QHash>
+#include <QVariantList>
+
+#include "dpkgstatusparser.h"
+
+// 根据 dpkg 状态事件的先后顺序，把墙钟时间归属到各个包的各个阶段。
+// dpkg 一次只处理一个包，因此两条事件之间的时间都属于前一条事件开始的阶段：
+//   unpack     processing: install/upgrade/unpack 到 unpacked（含 preinst 与解包）
+//   configure  processing: configure 到 half-configured（处理配置文件）
+//   postinst   half-configured 到 installed
+//   trigger    processing: trigproc
+//   remove     processing: remove/purge/disappear（含 prerm/postrm）
+//   prompt     等待用户回答配置文件提示
+//   dpkg       其余时间，包括 dpkg 启动与数据库写入
+class InstallTimeline
+{
+public:
+    struct Entry {
+        QString package;
+        QString phase;
+        qint64 duration;   // 毫秒
+        int runs;
+    };
+
+    InstallTimeline();
+
+    void addEvent(const DpkgStatusParser::Event &event);
+    // 最后一条事件之后的时间计入 dpkg，timestamp 与事件使用同一时钟
+    void finish(qint64 timestamp);
+
+    QList<Entry> entries() const;
+    QVariantList toVariantList() const;
+
+private:
+    void begin(const QString &package, const QString &phase, qint64 timestamp);
+
+private:
+    QString m_package;
+    QString m_phase;
+    qint64 m_start;
+
+    QList<Entry> m_entries;
+    QHash<QString, int> m_index;
+};
+
+#endif // INSTALLTIMELINE_H
@@ -0,0 +1,57 @@
+/*
+ * Copyright (C) 2021 Cutefish Technology Co., Ltd.
+ *
+ * Author:     Reion Wong <reion@cutefishos.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef IOPRIORITY_H
+#define IOPRIORITY_H
+
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// ioprio_set(2) 的简单封装，glibc 没有提供对应的函数
+class IoPriority
+{
+public:
+    enum Class {
+        RealTime = 1,
+        BestEffort = 2,
+        Idle = 3,
+    };
+
+    // pid 为 0 时只作用于调用线程；level 为 0（最高）到 7（最低），Idle 时忽略
+    static bool set(Class ioClass, int level = 0, pid_t pid = 0)
+    {
+        return restore((ioClass << ClassShift) | level, pid);
+    }
+
+    // ioprio_get(2) 的原始值，失败时为 -1；用于之后交给 restore() 恢复
+    static int get(pid_t pid = 0)
+    {
+        return ::syscall(SYS_ioprio_get, WhoProcess, pid);
+    }
+
+    static bool restore(int value, pid_t pid = 0)
+    {
+        return ::syscall(SYS_ioprio_set, WhoProcess, pid, value) == 0;
+    }
+
+private:
+    static const int WhoProcess = 1;
+    static const int ClassShift = 13;
+};
+
+#endif // IOPRIORITY_H
@@ -23,11 +23,262 @@
 #include <QCommandLineParser>
 #include <QTranslator>
 #include <QFile>
+#include <QFileInfo>
+#include <QWindow>
+#include <QDebug>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTextStream>
+#include <QStandardPaths>
+#include <QFutureWatcher>
+#include <QtConcurrent/QtConcurrent>
+
+#include <apt-pkg/configuration.h>
+#include <apt-pkg/init.h>
+#include <apt-pkg/pkgsystem.h>
+
+#include <functional>
+
+#include <sys/resource.h>
+#include <unistd.h>
 
 #include "debinstaller.h"
+#include "singleinstance.h"
+#include "cliinstaller.h"
+#include "targetroot.h"
+#include "debextractor.h"
+#include "remotepackage.h"
+#include "folderwatcher.h"
+#include "packagescanner.h"
+#include "iopriority.h"
+
+static void addOptions(QCommandLineParser &parser)
+{
+    parser.addHelpOption();
+    parser.addVersionOption();
+    parser.addOption(QCommandLineOption("cli", "Install the given packages without showing a window"));
+    parser.addOption(QCommandLineOption("json", "Print a machine-readable report (implies --cli)"));
+    parser.addOption(QCommandLineOption("conffile", "Handle modified configuration files: keep or replace", "policy", "keep"));
+    parser.addOption(QCommandLineOption("verify", "Verify installed files against the package checksums after installing"));
+    parser.addOption(QCommandLineOption("repair", "If the same version is installed, only restore files that differ from the package"));
+    parser.addOption(QCommandLineOption("profile", "Install profile: safe, fast (low priority) or ephemeral (no fsync, for throwaway systems)", "profile", "safe"));
+    parser.addOption(QCommandLineOption("cpu-weight", "CPU weight of the install processes, 1-10000 (desktop sessions use 100)", "weight", "50"));
+    parser.addOption(QCommandLineOption("io-weight", "I/O weight of the install processes, 1-10000", "weight", "50"));
+    parser.addOption(QCommandLineOption("memory-high", "Throttle the install processes above this much memory, in MiB (0: no limit)", "MiB", "0"));
+    parser.addOption(QCommandLineOption("watch", "Pre-analyse new packages in the given folders (default: Downloads) in the background"));
+    parser.addOption(QCommandLineOption("manifest", "Install the packages listed in a JSON manifest with their SHA256 and minimum version, skipping those already satisfied", "file"));
+    parser.addOption(QCommandLineOption("extract", "Only unpack the packages' files into the given directory, like dpkg -x", "directory"));
+    parser.addOption(QCommandLineOption("root", "Install into the given root directory instead of the running system", "directory"));
+    parser.addOption(QCommandLineOption("admindir", "Use the given dpkg database directory (default: <root>/var/lib/dpkg)", "directory"));
+    parser.addPositionalArgument("files", ".deb files or directories containing them", "[files...]");
+}
+
+// 转为绝对路径，转交给已运行的实例时不依赖当前工作目录。
+// 目录原样保留，窗口在线程池中扫描，不在显示之前阻塞界面线程
+static QStringList absoluteFiles(const QStringList &arguments)
+{
+    QStringList fileNames;
+    for (const QString &arg : arguments) {
+        if (RemotePackage::isRemote(arg)) {
+            fileNames << arg;
+            continue;
+        }
+
+        QString path = arg;
+        fileNames << QFileInfo(path.remove("file://")).absoluteFilePath();
+    }
+    return fileNames;
+}
+
+// 命令行模式没有界面，直接展开目录：其中的包去重后按路径顺序加入
+static QStringList expandDirectories(const QStringList &fileNames)
+{
+    QStringList expanded;
+    for (const QString &fileName : fileNames) {
+        if (RemotePackage::isRemote(fileName) || !QFileInfo(fileName).isDir()) {
+            expanded << fileName;
+            continue;
+        }
+
+        const PackageScanner::Result result = PackageScanner::scan(fileName);
+        for (const QString &file : result.skipped) {
+            qInfo() << "Skipping duplicate or older package" << file;
+        }
+        for (const QString &file : result.invalid) {
+            qWarning() << "Ignoring" << file << ": not a Debian package";
+        }
+        expanded << result.files;
+    }
+    return expanded;
+}
+
+// 不需要 APT 缓存、dpkg 锁和特权，直接在当前进程中解压
+static int runExtract(const QStringList &fileNames, const QString &destination, bool json)
+{
+    QTextStream err(stderr);
+    QJsonArray reports;
+    bool success = true;
+
+    for (const QString &fileName : fileNames) {
+        const DebExtractor::Result result = DebExtractor::extract(fileName, destination);
+        success = success && result.success;
+
+        if (json) {
+            QJsonObject report;
+            report["file"] = fileName;
+            report["success"] = result.success;
+            report["error"] = result.errorString;
+            report["files"] = result.files;
+            report["bytes"] = result.bytes;
+            report["elapsed"] = result.elapsed;
+            reports << report;
+        } else if (result.success) {
+            err << QCoreApplication::translate("main", "Extracted %1 files (%2 bytes) from %3 in %4 ms")
+                   .arg(result.files).arg(result.bytes).arg(fileName).arg(result.elapsed) << Qt::endl;
+        } else {
+            err << fileName << ": " << result.errorString << Qt::endl;
+        }
+    }
+
+    if (json) {
+        QTextStream(stdout) << QJsonDocument(reports).toJson();
+    }
+
+    return success ? 0 : 1;
+}
+
+// 新下载的包在空闲时完成分析并写入缓存，界面打开时直接使用缓存的结论
+static int runWatch(QCoreApplication &app, QStringList folders)
+{
+    // 之后创建的线程与 dpkg 进程都继承最低的 CPU 与 IO 优先级
+    ::setpriority(PRIO_PROCESS, 0, 19);
+    IoPriority::set(IoPriority::Idle);
+
+    // 依赖检查需要 libapt 求解缺失的依赖
+    if (!pkgInitConfig(*_config) || !pkgInitSystem(*_config, _system)) {
+        qWarning() << "Failed to initialize APT";
+        return 1;
+    }
+
+    if (folders.isEmpty()) {
+        folders << QStandardPaths::writableLocation(QStandardPaths::DownloadLocation);
+    }
+
+    FolderWatcher watcher;
+    for (const QString &folder : folders) {
+        if (!watcher.addPath(folder)) {
+            qWarning() << "Cannot watch" << folder;
+        }
+    }
+
+    // 只解析控制信息并检查依赖，不创建安装后端，也不预读或与软件源比较
+    QFutureWatcher<bool> analysis;
+    QStringList pending;
+
+    std::function<void()> next = [&]() {
+        if (analysis.isRunning() || pending.isEmpty()) {
+            return;
+        }
+
+        const QString fileName = pending.takeFirst();
+        analysis.setFuture(QtConcurrent::run([fileName]() {
+            return DebInstaller::analyse(fileName);
+        }));
+    };
+
+    // 正在分析的文件再次写入时重新排队，之前的结论可能已经过期
+    QObject::connect(&watcher, &FolderWatcher::packageArrived, &app, [&](const QString &fileName) {
+        if (!pending.contains(fileName)) {
+            pending << fileName;
+            next();
+        }
+    });
+    QObject::connect(&analysis, &QFutureWatcher<bool>::finished, &app, next);
+
+    return app.exec();
+}
+
+static int runCli(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    addOptions(parser);
+    parser.process(app);
+
+    if (parser.isSet("watch")) {
+        return runWatch(app, parser.positionalArguments());
+    }
+
+    const QStringList fileNames = expandDirectories(absoluteFiles(parser.positionalArguments()));
+    if (fileNames.isEmpty() && !parser.isSet("manifest")) {
+        parser.showHelp(1);
+    }
+
+    // 命令行模式没有后台下载，需要先下载到本地
+    for (const QString &fileName : fileNames) {
+        if (RemotePackage::isRemote(fileName)) {
+            qWarning() << "URLs can only be opened in the window:" << fileName;
+            return 1;
+        }
+    }
+
+    if (parser.isSet("extract")) {
+        return runExtract(fileNames, parser.value("extract"), parser.isSet("json"));
+    }
+
+    const QString conffilePolicy = parser.value("conffile");
+    if (conffilePolicy != "keep" && conffilePolicy != "replace") {
+        qWarning() << "Unknown conffile policy:" << conffilePolicy;
+        return 1;
+    }
+
+    const QString profile = parser.value("profile");
+    if (profile != "safe" && profile != "fast" && profile != "ephemeral") {
+        qWarning() << "Unknown install profile:" << profile;
+        return 1;
+    }
+
+    // 以 root 运行时在进程内安装，需要初始化 APT
+    if (::geteuid() == 0 && (!pkgInitConfig(*_config) || !pkgInitSystem(*_config, _system))) {
+        qWarning() << "Failed to initialize APT";
+        return 1;
+    }
+
+    // 没有人回答问题，debconf 使用预置的默认值
+    QVariantMap options;
+    options["conffilePolicy"] = conffilePolicy;
+    options["debconfPolicy"] = "defaults";
+    options["repair"] = parser.isSet("repair");
+    options["verify"] = parser.isSet("verify");
+    options["profile"] = profile;
+    options["cpuWeight"] = qBound(1, parser.value("cpu-weight").toInt(), 10000);
+    options["ioWeight"] = qBound(1, parser.value("io-weight").toInt(), 10000);
+    options["memoryHigh"] = parser.value("memory-high").toLongLong() * 1024 * 1024;
+    TargetRoot(parser.value("root"), parser.value("admindir")).insertInto(options);
+
+    CliInstaller installer(parser.isSet("json"));
+    if (parser.isSet("manifest")) {
+        installer.provision(parser.value("manifest"), options);
+    } else {
+        installer.install(fileNames, options);
+    }
+
+    return app.exec();
+}
 
 int main(int argc, char *argv[])
 {
+    // 命令行模式不需要图形界面，在创建 QApplication 之前判断
+    for (int i = 1; i < argc; ++i) {
+        if (qstrcmp(argv[i], "--cli") == 0 || qstrcmp(argv[i], "--json") == 0
+                || qstrcmp(argv[i], "--watch") == 0 || qstrncmp(argv[i], "--extract", 9) == 0
+                || qstrncmp(argv[i], "--manifest", 10) == 0) {
+            return runCli(argc, argv);
+        }
+    }
+
 #if QT_VERSION < QT_VERSION_CHECK(6, 0, 0)
     QCoreApplication::setAttribute(Qt::AA_EnableHighDpiScaling);
 #endif
@@ -53,14 +304,18 @@ int main(int argc, char *argv[])
     qmlRegisterUncreatableType<DebInstaller>("Cutefish.DebInstaller", 1, 0, "DebInstaller", "error");
 
     QCommandLineParser parser;
-    parser.addHelpOption();
-    parser.addVersionOption();
-    parser.addPositionalArgument("file", ".deb file");
+    addOptions(parser);
     parser.process(app);
 
-    QString fileName;
-    if (!parser.positionalArguments().isEmpty()) {
-        fileName = parser.positionalArguments().first();
+    const QStringList fileNames = absoluteFiles(parser.positionalArguments());
+
+    // 已有实例在运行时，把文件交给它处理，只显示一个窗口。
+    // 安装到其它根目录的窗口各自独立，既不转交也不接收，文件不会被装到另一个目标中
+    const TargetRoot root(parser.value("root"), parser.value("admindir"));
+    SingleInstance instance;
+    if (root.isHost() && !instance.listen()) {
+        if (instance.sendFiles(fileNames))
+            return 0;
     }
 
     QQmlApplicationEngine engine;
@@ -72,9 +327,30 @@ int main(int argc, char *argv[])
     }, Qt::QueuedConnection);
 
     DebInstaller *debInstaller = new DebInstaller;
+    if (!root.isHost()) {
+        debInstaller->setTargetRoot(parser.value("root"), parser.value("admindir"));
+    }
     engine.rootContext()->setContextProperty("Installer", debInstaller);
     engine.load(url);
-    debInstaller->setFileName(fileName);
+    debInstaller->addFiles(fileNames);
+
+    QObject::connect(&instance, &SingleInstance::filesReceived, debInstaller, [&engine, debInstaller](const QStringList &files) {
+        // 转交来的文件都是给主机的，窗口之后切换到其它根目录时不再接收
+        if (!TargetRoot(debInstaller->rootDir(), debInstaller->adminDir()).isHost()) {
+            qWarning() << "Ignoring files forwarded to a window that installs into" << debInstaller->rootDir();
+            return;
+        }
+
+        debInstaller->addFiles(files);
+
+        if (!engine.rootObjects().isEmpty()) {
+            if (QWindow *window = qobject_cast<QWindow *>(engine.rootObjects().first())) {
+                window->show();
+                window->raise();
+                window->requestActivate();
+            }
+        }
+    });
 
     return app.exec();
 }
@@ -0,0 +1,317 @@
+/*
+ * Copyright (C) 2021 Cutefish Technology Co., Ltd.
+ *
+ * Author:     Reion Wong <reion@cutefishos.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "packagefilesmodel.h"
+#include <QThread>
+#include <QElapsedTimer>
+#include <QSet>
+
+#include <algorithm>
+#include <utility>
+
+namespace {
+
+// 第一批尽快送到界面，之后按数量或时间分批
+const int FirstBatchSize = 256;
+const int BatchSize = 4096;
+const int BatchInterval = 100;
+
+}
+
+PackageFilesModel::PackageFilesModel(QObject *parent)
+    : QAbstractItemModel(parent)
+    , m_loaded(false)
+    , m_loading(false)
+    , m_fileCount(0)
+{
+    m_nodes.append(Node { -1, 0, -1, true, 0, 0, {} });
+}
+
+PackageFilesModel::~PackageFilesModel()
+{
+    cancel();
+    for (QThread *thread : std::as_const(m_threads)) {
+        thread->wait();
+        delete thread;
+    }
+}
+
+void PackageFilesModel::setFileName(const QString &fileName)
+{
+    cancel();
+
+    beginResetModel();
+    m_fileName = fileName;
+    m_nodes.clear();
+    m_nodes.append(Node { -1, 0, -1, true, 0, 0, {} });
+    m_segments.clear();
+    m_segmentIds.clear();
+    m_childIds.clear();
+    endResetModel();
+
+    m_loaded = false;
+    m_fileCount = 0;
+    emit fileCountChanged();
+
+    if (m_loading) {
+        m_loading = false;
+        emit loadingChanged();
+    }
+}
+
+void PackageFilesModel::load()
+{
+    if (m_loaded || m_fileName.isEmpty()) {
+        return;
+    }
+
+    m_loaded = true;
+    m_loading = true;
+    emit loadingChanged();
+
+    auto cancelled = std::make_shared<std::atomic<bool>>(false);
+    m_cancelled = cancelled;
+    const QString fileName = m_fileName;
+
+    QThread *thread = QThread::create([this, fileName, cancelled]() {
+        QVector<DebArchive::Entry> batch;
+        int limit = FirstBatchSize;
+        QElapsedTimer timer;
+        timer.start();
+
+        auto flush = [&]() {
+            QMetaObject::invokeMethod(this, [this, cancelled, batch = std::move(batch)]() {
+                if (!*cancelled) {
+                    appendBatch(batch);
+                }
+            }, Qt::QueuedConnection);
+
+            batch.clear();
+            limit = BatchSize;
+            timer.restart();
+        };
+
+        DebArchive::readEntries(fileName, [&](const DebArchive::Entry &entry) {
+            batch << entry;
+            if (batch.size() >= limit || timer.elapsed() >= BatchInterval) {
+                flush();
+            }
+            return !*cancelled;
+        });
+
+        if (!batch.isEmpty()) {
+            flush();
+        }
+
+        QMetaObject::invokeMethod(this, [this, cancelled]() {
+            if (!*cancelled) {
+                finishLoading();
+            }
+        }, Qt::QueuedConnection);
+    });
+
+    connect(thread, &QThread::finished, this, [this, thread]() {
+        m_threads.removeOne(thread);
+        thread->deleteLater();
+    });
+    m_threads << thread;
+    thread->start(QThread::LowPriority);
+}
+
+bool PackageFilesModel::loading() const
+{
+    return m_loading;
+}
+
+int PackageFilesModel::fileCount() const
+{
+    return m_fileCount;
+}
+
+void PackageFilesModel::cancel()
+{
+    if (m_cancelled) {
+        *m_cancelled = true;
+        m_cancelled.reset();
+    }
+}
+
+void PackageFilesModel::finishLoading()
+{
+    m_loading = false;
+    emit loadingChanged();
+}
+
+int PackageFilesModel::intern(const QString &segment)
+{
+    auto it = m_segmentIds.constFind(segment);
+    if (it != m_segmentIds.constEnd()) {
+        return it.value();
+    }
+
+    const int id = m_segments.size();
+    m_segments << segment;
+    m_segmentIds.insert(segment, id);
+    return id;
+}
+
+int PackageFilesModel::findOrAddChild(int parent, const QString &name, bool isDirectory)
+{
+    const int nameId = intern(name);
+    const quint64 key = (quint64(parent) << 32) | quint32(nameId);
+
+    auto it = m_childIds.constFind(key);
+    if (it != m_childIds.constEnd()) {
+        return it.value();
+    }
+
+    const int id = m_nodes.size();
+    const int row = m_nodes[parent].children.size();
+    m_nodes.append(Node { parent, row, nameId, isDirectory, 0, 0, {} });
+    m_nodes[parent].children.append(id);
+    m_childIds.insert(key, id);
+    return id;
+}
+
+void PackageFilesModel::appendBatch(const QVector<DebArchive::Entry> &batch)
+{
+    QSet<int> touched;
+    int files = 0;
+
+    for (const DebArchive::Entry &entry : batch) {
+        const QStringList parts = entry.path.split('/', Qt::SkipEmptyParts);
+
+        int node = 0;
+        for (int i = 0; i < parts.size(); ++i) {
+            const bool isLast = i == parts.size() - 1;
+            const int count = m_nodes.size();
+            const int child = findOrAddChild(node, parts.at(i), !isLast || entry.isDirectory);
+            if (m_nodes.size() > count) {
+                touched.insert(node);
+            }
+            node = child;
+        }
+
+        if (!entry.isDirectory && node != 0) {
+            m_nodes[node].size = entry.size;
+            ++files;
+        }
+    }
+
+    // 祖先节点的下标总是更小，按下标顺序通知，父节点先于其子节点出现在视图中
+    QList<int> parents = touched.values();
+    std::sort(parents.begin(), parents.end());
+
+    for (int parent : std::as_const(parents)) {
+        const QModelIndex parentIndex = parent == 0 ? QModelIndex() : createIndex(m_nodes[parent].row, 0, parent);
+        beginInsertRows(parentIndex, m_nodes[parent].exposed, m_nodes[parent].children.size() - 1);
+        m_nodes[parent].exposed = m_nodes[parent].children.size();
+        endInsertRows();
+    }
+
+    if (files > 0) {
+        m_fileCount += files;
+        emit fileCountChanged();
+    }
+}
+
+QString PackageFilesModel::path(int node) const
+{
+    QStringList parts;
+    for (; node > 0; node = m_nodes[node].parent) {
+        parts.prepend(m_segments.at(m_nodes[node].name));
+    }
+    return "/" + parts.join('/');
+}
+
+QModelIndex PackageFilesModel::index(int row, int column, const QModelIndex &parent) const
+{
+    const int node = parent.isValid() ? int(parent.internalId()) : 0;
+    if (column != 0 || row < 0 || row >= m_nodes[node].exposed) {
+        return QModelIndex();
+    }
+
+    return createIndex(row, column, m_nodes[node].children.at(row));
+}
+
+QModelIndex PackageFilesModel::parent(const QModelIndex &child) const
+{
+    if (!child.isValid()) {
+        return QModelIndex();
+    }
+
+    const int parent = m_nodes[int(child.internalId())].parent;
+    if (parent <= 0) {
+        return QModelIndex();
+    }
+
+    return createIndex(m_nodes[parent].row, 0, parent);
+}
+
+int PackageFilesModel::rowCount(const QModelIndex &parent) const
+{
+    if (parent.column() > 0) {
+        return 0;
+    }
+
+    return m_nodes[parent.isValid() ? int(parent.internalId()) : 0].exposed;
+}
+
+int PackageFilesModel::columnCount(const QModelIndex &parent) const
+{
+    Q_UNUSED(parent);
+    return 1;
+}
+
+bool PackageFilesModel::hasChildren(const QModelIndex &parent) const
+{
+    return rowCount(parent) > 0;
+}
+
+QVariant PackageFilesModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid()) {
+        return QVariant();
+    }
+
+    const int id = int(index.internalId());
+    const Node &node = m_nodes[id];
+
+    switch (role) {
+    case Qt::DisplayRole:
+        return m_segments.at(node.name);
+    case Qt::ToolTipRole:
+    case PathRole:
+        return path(id);
+    case FileSizeRole:
+        return node.size;
+    case IsDirectoryRole:
+        return node.isDirectory;
+    }
+
+    return QVariant();
+}
+
+QHash<int, QByteArray> PackageFilesModel::roleNames() const
+{
+    QHash<int, QByteArray> roles = QAbstractItemModel::roleNames();
+    roles[PathRole] = "path";
+    roles[FileSizeRole] = "fileSize";
+    roles[IsDirectoryRole] = "isDirectory";
+    return roles;
+}
@@ -0,0 +1,105 @@
+/*
+ * Copyright (C) 2021 Cutefish Technology Co., Ltd.
+ *
+ * Author:     Reion Wong <reion@cutefishos.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef PACKAGEFILESMODEL_H
+#define PACKAGEFILESMODEL_H
+
+#include <QAbstractItemModel>
+#include <QHash>
+#include <QStringList>
+#include <QVector>
+
+#include <atomic>
+#include <memory>
+
+#include "debarchive.h"
+
+class QThread;
+
+// "包含的文件" 树：在工作线程中流式读取 data.tar 的头部，分批插入，
+// 第一批到达后即可浏览。路径按段存储，相同的目录名只保存一份
+class PackageFilesModel : public QAbstractItemModel
+{
+    Q_OBJECT
+    Q_PROPERTY(bool loading READ loading NOTIFY loadingChanged)
+    Q_PROPERTY(int fileCount READ fileCount NOTIFY fileCountChanged)
+
+public:
+    enum Roles {
+        PathRole = Qt::UserRole + 1,
+        FileSizeRole,
+        IsDirectoryRole,
+    };
+
+    explicit PackageFilesModel(QObject *parent = nullptr);
+    ~PackageFilesModel();
+
+    // 设置新文件时清空模型并取消正在进行的读取，真正的读取在 load() 时开始
+    void setFileName(const QString &fileName);
+    Q_INVOKABLE void load();
+
+    bool loading() const;
+    int fileCount() const;
+
+    QModelIndex index(int row, int column, const QModelIndex &parent = QModelIndex()) const override;
+    QModelIndex parent(const QModelIndex &child) const override;
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex &parent = QModelIndex()) const override;
+    bool hasChildren(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+    QHash<int, QByteArray> roleNames() const override;
+
+signals:
+    void loadingChanged();
+    void fileCountChanged();
+
+private:
+    struct Node {
+        int parent;
+        int row;           // 在父节点中的行号
+        int name;          // m_segments 中的下标
+        bool isDirectory;
+        qint64 size;
+        int exposed;       // 已通知视图的子节点数
+        QVector<int> children;
+    };
+
+    void cancel();
+    void appendBatch(const QVector<DebArchive::Entry> &batch);
+    void finishLoading();
+    int intern(const QString &segment);
+    int findOrAddChild(int parent, const QString &name, bool isDirectory);
+    QString path(int node) const;
+
+private:
+    QString m_fileName;
+    bool m_loaded;
+    bool m_loading;
+    int m_fileCount;
+
+    // 节点 0 为根目录，QModelIndex 的 internalId 为节点下标
+    QVector<Node> m_nodes;
+    QStringList m_segments;
+    QHash<QString, int> m_segmentIds;
+    QHash<quint64, int> m_childIds;
+
+    QList<QThread *> m_threads;
+    std::shared_ptr<std::atomic<bool>> m_cancelled;
+};
+
+#endif // PACKAGEFILESMODEL_H
@@ -0,0 +1,160 @@
+/*
+ * Copyright (C) 2021 Cutefish Technology Co., Ltd.
+ *
+ * Author:     Reion Wong <reion@cutefishos.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "packageprefetcher.h"
+#include "debarchive.h"
+#include "iopriority.h"
+#include <QThread>
+#include <QFile>
+#include <QElapsedTimer>
+
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+const off_t ReadaheadChunk = 4 * 1024 * 1024;
+
+bool readahead(const QString &debFile, const std::atomic<bool> &cancelled)
+{
+    int fd = ::open(QFile::encodeName(debFile).constData(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+        ::close(fd);
+        return false;
+    }
+
+    // WILLNEED 只是提示，分块 readahead 保证读入并能随时取消
+    ::posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+    for (off_t offset = 0; offset < st.st_size && !cancelled; offset += ReadaheadChunk) {
+        ::readahead(fd, offset, ReadaheadChunk);
+    }
+
+    ::close(fd);
+    return !cancelled;
+}
+
+}
+
+PackagePrefetcher::PackagePrefetcher(QObject *parent)
+    : QObject(parent)
+    , m_verifyArchive(true)
+{
+}
+
+PackagePrefetcher::~PackagePrefetcher()
+{
+    // 已取消的线程会在下一个数据块后结束
+    cancel();
+    for (QThread *thread : std::as_const(m_threads)) {
+        thread->wait();
+        delete thread;
+    }
+}
+
+void PackagePrefetcher::setVerifyArchive(bool verify)
+{
+    m_verifyArchive = verify;
+}
+
+void PackagePrefetcher::prefetch(const QString &debFile)
+{
+    cancel();
+
+    // 每次预读使用独立的取消标记，被取消的线程自行结束，不阻塞界面
+    auto cancelled = std::make_shared<std::atomic<bool>>(false);
+    m_cancelled = cancelled;
+    const bool verify = m_verifyArchive;
+
+    QThread *thread = QThread::create([this, debFile, cancelled, verify]() {
+        IoPriority::set(IoPriority::Idle);
+
+        QElapsedTimer timer;
+        timer.start();
+
+        bool archiveOk = readahead(debFile, *cancelled);
+        if (archiveOk && verify) {
+            archiveOk = DebArchive::verifyData(debFile, cancelled.get());
+        }
+
+        if (!*cancelled) {
+            QMetaObject::invokeMethod(this, [this, debFile, cancelled, archiveOk, elapsed = timer.elapsed()]() {
+                if (!*cancelled) {
+                    emit finished(debFile, archiveOk, elapsed);
+                }
+            }, Qt::QueuedConnection);
+        }
+    });
+
+    connect(thread, &QThread::finished, this, [this, thread]() {
+        m_threads.removeOne(thread);
+        thread->deleteLater();
+    });
+    m_threads << thread;
+    thread->start(QThread::IdlePriority);
+}
+
+void PackagePrefetcher::cancel()
+{
+    if (m_cancelled) {
+        *m_cancelled = true;
+        m_cancelled.reset();
+    }
+}
+
+double PackagePrefetcher::residency(const QString &file)
+{
+    int fd = ::open(QFile::encodeName(file).constData(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return 0;
+    }
+
+    struct stat st;
+    if (::fstat(fd, &st) != 0 || st.st_size == 0) {
+        ::close(fd);
+        return 0;
+    }
+
+    void *addr = ::mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (addr == MAP_FAILED) {
+        return 0;
+    }
+
+    const long pageSize = ::sysconf(_SC_PAGESIZE);
+    std::vector<unsigned char> pages((st.st_size + pageSize - 1) / pageSize);
+
+    size_t resident = 0;
+    if (::mincore(addr, st.st_size, pages.data()) == 0) {
+        for (unsigned char page : pages) {
+            resident += page & 1;
+        }
+    }
+
+    ::munmap(addr, st.st_size);
+    return double(resident) / pages.size();
+}
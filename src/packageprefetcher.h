@@ -0,0 +1,60 @@
+/*
+ * Copyright (C) 2021 Cutefish Technology Co., Ltd.
+ *
+ * Author:     Reion Wong <reion@cutefishos.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef PACKAGEPREFETCHER_H
+#define PACKAGEPREFETCHER_H
+
+#include <QObject>
+#include <QString>
+#include <QList>
+
+#include <atomic>
+#include <memory>
+
+class QThread;
+
+// 用户查看包信息期间，以最低的 CPU 与 IO 优先级把 deb 读入页缓存，
+// 这样点击安装后 dpkg 第一次读取 data.tar 时不必等待磁盘或网络文件系统
+class PackagePrefetcher : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit PackagePrefetcher(QObject *parent = nullptr);
+    ~PackagePrefetcher();
+
+    // 预读的同时完整解压一遍 data.tar，提前发现损坏的包
+    void setVerifyArchive(bool verify);
+
+    // 取消正在进行的预读并开始新的预读
+    void prefetch(const QString &debFile);
+    void cancel();
+
+    // 文件已在页缓存中的比例（0 到 1），用于比较冷、热缓存下的安装时间
+    static double residency(const QString &file);
+
+signals:
+    void finished(const QString &debFile, bool archiveOk, qint64 elapsed);
+
+private:
+    QList<QThread *> m_threads;
+    std::shared_ptr<std::atomic<bool>> m_cancelled;
+    bool m_verifyArchive;
+};
+
+#endif // PACKAGEPREFETCHER_H
@@ -0,0 +1,140 @@
+/*
+ * Copyright (C) 2021 Cutefish Technology Co., Ltd.
+ *
+ * Author:     Reion Wong <reion@cutefishos.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "packagescanner.h"
+#include "debarchive.h"
+
+#include <QDirIterator>
+#include <QFileInfo>
+#include <QHash>
+#include <QtConcurrent/QtConcurrent>
+
+#include <apt-pkg/debversion.h>
+#include <apt-pkg/error.h>
+
+#include <algorithm>
+
+namespace {
+
+struct Candidate {
+    QString file;
+    QString package;
+    QString architecture;
+    QString version;
+};
+
+Candidate readCandidate(const QString &file)
+{
+    Candidate candidate;
+    candidate.file = file;
+
+    if (DebArchive::validate(file) != DebArchive::Valid) {
+        return candidate;
+    }
+
+    const QByteArray control = DebArchive::controlMember(file, "control");
+
+    // _error 按线程保存，不清除会让线程池中同一线程的下一个包也失败
+    _error->Discard();
+
+    candidate.package = DebArchive::controlField(control, "Package");
+    candidate.architecture = DebArchive::controlField(control, "Architecture");
+    candidate.version = DebArchive::controlField(control, "Version");
+    return candidate;
+}
+
+}
+
+QStringList PackageScanner::findPackages(const QString &directory)
+{
+    QStringList files;
+    QStringList subdirectories;
+
+    // 顶层的每个子目录各自在线程池中遍历
+    QDirIterator it(directory, QDir::Files | QDir::Dirs | QDir::NoDotAndDotDot);
+    while (it.hasNext()) {
+        const QString path = it.next();
+        const QFileInfo info = it.fileInfo();
+        if (info.isDir()) {
+            if (!info.isSymLink()) {
+                subdirectories << path;
+            }
+        } else if (path.endsWith(".deb")) {
+            files << path;
+        }
+    }
+
+    const QList<QStringList> nested = QtConcurrent::blockingMapped<QList<QStringList>>(subdirectories,
+                                                                                     [](const QString &subdirectory) {
+        QStringList found;
+        QDirIterator it(subdirectory, QStringList() << "*.deb", QDir::Files, QDirIterator::Subdirectories);
+        while (it.hasNext()) {
+            found << it.next();
+        }
+        return found;
+    });
+
+    for (const QStringList &found : nested) {
+        files << found;
+    }
+
+    std::sort(files.begin(), files.end());
+    return files;
+}
+
+PackageScanner::Result PackageScanner::scan(const QString &directory)
+{
+    Result result;
+
+    const QStringList files = findPackages(directory);
+    const QList<Candidate> candidates = QtConcurrent::blockingMapped<QList<Candidate>>(files, readCandidate);
+
+    // 版本相同时保留路径排在前面的包，结果与线程调度无关
+    QHash<QString, int> best;
+    for (int i = 0; i < candidates.size(); ++i) {
+        const Candidate &candidate = candidates.at(i);
+        if (candidate.package.isEmpty() || candidate.version.isEmpty()) {
+            result.invalid << candidate.file;
+            continue;
+        }
+
+        const QString key = candidate.package + ":" + candidate.architecture;
+        auto it = best.find(key);
+        if (it == best.end()) {
+            best.insert(key, i);
+            continue;
+        }
+
+        const Candidate &current = candidates.at(it.value());
+        if (debVS.CmpVersion(candidate.version.toStdString(), current.version.toStdString()) > 0) {
+            result.skipped << current.file;
+            it.value() = i;
+        } else {
+            result.skipped << candidate.file;
+        }
+    }
+
+    for (int i = 0; i < candidates.size(); ++i) {
+        const Candidate &candidate = candidates.at(i);
+        if (best.value(candidate.package + ":" + candidate.architecture, -1) == i) {
+            result.files << candidate.file;
+        }
+    }
+
+    return result;
+}
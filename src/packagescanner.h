@@ -0,0 +1,42 @@
+/*
+ * Copyright (C) 2021 Cutefish Technology Co., Ltd.
+ *
+ * Author:     Reion Wong <reion@cutefishos.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef PACKAGESCANNER_H
+#define PACKAGESCANNER_H
+
+#include <QString>
+#include <QStringList>
+
+// 厂商的驱动包常以目录形式提供，其中可能有重复或较旧的版本。
+// 并行遍历目录、检查并解析每个 deb，同一 (Package, Architecture) 只保留最高版本
+class PackageScanner
+{
+public:
+    struct Result {
+        QStringList files;    // 可以一起安装的包，按路径排序
+        QStringList skipped;  // 重复或版本较低的包
+        QStringList invalid;  // 不是完整的 deb 或缺少控制信息
+    };
+
+    // 阻塞调用，递归查找 directory 下的 *.deb，不跟随指向目录的符号链接
+    static Result scan(const QString &directory);
+
+    static QStringList findPackages(const QString &directory);
+};
+
+#endif // PACKAGESCANNER_H
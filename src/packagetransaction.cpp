@@ -0,0 +1,909 @@
+/*
+ * Copyright (C) 2021 Cutefish Technology Co., Ltd.
+ *
+ * Author:     Reion Wong <reion@cutefishos.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "packagetransaction.h"
+#include "debarchive.h"
+#include "packageprefetcher.h"
+#include "installedfiles.h"
+#include "installcgroup.h"
+#include <QThread>
+#include <QFile>
+#include <QFileInfo>
+#include <QElapsedTimer>
+#include <QDeadlineTimer>
+#include <QFuture>
+#include <QDebug>
+#include <QtConcurrent/QtConcurrent>
+
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <string>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <apt-pkg/acquire.h>
+#include <apt-pkg/acquire-item.h>
+#include <apt-pkg/algorithms.h>
+#include <apt-pkg/configuration.h>
+#include <apt-pkg/debfile.h>
+#include <apt-pkg/depcache.h>
+#include <apt-pkg/error.h>
+#include <apt-pkg/fileutl.h>
+#include <apt-pkg/install-progress.h>
+#include <apt-pkg/packagemanager.h>
+#include <apt-pkg/pkgrecords.h>
+#include <apt-pkg/pkgsystem.h>
+#include <apt-pkg/sourcelist.h>
+
+namespace {
+
+// 等待界面回答配置文件提示的最长时间，超时后保留当前版本
+const int ConffileAnswerTimeout = 10 * 60 * 1000;
+
+// 统计每个触发器会被本次安装的多少个包激活
+QHash<QString, int> countTriggerActivations(const QStringList &debFiles, const QString &adminDir)
+{
+    // 文件触发器：每行为 "<路径> <包名>[:架构][/noawait]"
+    QHash<QString, QStringList> fileInterests;
+    QFile interestFile(adminDir + "/triggers/File");
+    if (interestFile.open(QIODevice::ReadOnly)) {
+        while (!interestFile.atEnd()) {
+            const QStringList parts = QString::fromUtf8(interestFile.readLine()).simplified().split(' ');
+            if (parts.size() == 2) {
+                fileInterests[parts[0]] << parts[1].section('/', 0, 0).section(':', 0, 0);
+            }
+        }
+    }
+
+    const QList<QSet<QString>> triggered = QtConcurrent::blockingMapped<QList<QSet<QString>>>(debFiles,
+                                                                                            [&fileInterests](const QString &debFile) {
+        QSet<QString> packages;
+
+        // 沿着父目录向上查找，避免逐条比较所有关注路径
+        for (QString path : DebArchive::files(debFile)) {
+            while (!path.isEmpty()) {
+                auto it = fileInterests.constFind(path);
+                if (it != fileInterests.constEnd()) {
+                    for (const QString &package : it.value()) {
+                        packages.insert(package);
+                    }
+                }
+                path = path.left(path.lastIndexOf('/'));
+            }
+        }
+
+        // 显式触发器：control.tar 中的 triggers 文件
+        const QList<QByteArray> lines = DebArchive::controlMember(debFile, "triggers").split('\n');
+        for (const QByteArray &line : lines) {
+            const QList<QByteArray> words = line.simplified().split(' ');
+            if (words.size() < 2 || !words[0].startsWith("activate") || words[1].contains('/')) {
+                continue;
+            }
+
+            QFile interested(adminDir + "/triggers/" + QString::fromUtf8(words[1]));
+            if (interested.open(QIODevice::ReadOnly)) {
+                while (!interested.atEnd()) {
+                    QString package = QString::fromUtf8(interested.readLine()).trimmed();
+                    if (!package.isEmpty()) {
+                        packages.insert(package.section('/', 0, 0).section(':', 0, 0));
+                    }
+                }
+            }
+        }
+
+        return packages;
+    });
+
+    QHash<QString, int> activations;
+    for (const QSet<QString> &packages : triggered) {
+        for (const QString &package : packages) {
+            activations[package] += 1;
+        }
+    }
+    return activations;
+}
+
+QString takeAptErrors()
+{
+    QStringList messages;
+    std::string message;
+    while (!_error->empty()) {
+        if (_error->PopMessage(message)) {
+            messages << QString::fromStdString(message);
+        }
+    }
+    return messages.join('\n');
+}
+
+class AcquireStatus : public pkgAcquireStatus
+{
+public:
+    explicit AcquireStatus(PackageTransaction *transaction)
+        : m_transaction(transaction)
+    {
+    }
+
+    void Fetch(pkgAcquire::ItemDesc &item) override
+    {
+        emit m_transaction->message(PackageTransaction::tr("Get: %1").arg(QString::fromStdString(item.Description)));
+    }
+
+    void Done(pkgAcquire::ItemDesc &item) override
+    {
+        emit m_transaction->message(PackageTransaction::tr("Done: %1").arg(QString::fromStdString(item.ShortDesc)));
+    }
+
+    void Fail(pkgAcquire::ItemDesc &item) override
+    {
+        emit m_transaction->message(PackageTransaction::tr("Failed: %1 (%2)")
+                                    .arg(QString::fromStdString(item.Description))
+                                    .arg(QString::fromStdString(item.Owner->ErrorText)));
+    }
+
+    bool MediaChange(std::string, std::string) override
+    {
+        return false;
+    }
+
+private:
+    PackageTransaction *m_transaction;
+};
+
+// 把 APT 的安装进度回调转换为 Qt 信号
+class InstallProgress : public APT::Progress::PackageManager
+{
+public:
+    explicit InstallProgress(PackageTransaction *transaction)
+        : m_transaction(transaction)
+    {
+    }
+
+    bool StatusChanged(std::string packageName, unsigned int stepsDone, unsigned int totalSteps,
+                       std::string humanReadableAction) override
+    {
+        Q_UNUSED(packageName);
+
+        double percent = totalSteps > 0 ? stepsDone * 100.0 / totalSteps : 0;
+        emit m_transaction->progressChanged(percent, QString::fromStdString(humanReadableAction));
+        return true;
+    }
+
+    void Error(std::string packageName, unsigned int, unsigned int, std::string errorMessage) override
+    {
+        emit m_transaction->message(PackageTransaction::tr("Error: %1: %2")
+                                    .arg(QString::fromStdString(packageName))
+                                    .arg(QString::fromStdString(errorMessage)));
+    }
+
+private:
+    PackageTransaction *m_transaction;
+};
+
+}
+
+PackageTransaction::PackageTransaction(QObject *parent)
+    : QObject(parent)
+    , m_cacheFile(nullptr)
+    , m_deferTriggers(true)
+    , m_conffilePolicy("keep")
+    , m_verify(false)
+    , m_profile("safe")
+    , m_cpuWeight(50)
+    , m_ioWeight(50)
+    , m_memoryHigh(0)
+    , m_inputFd(-1)
+    , m_conffilePending(false)
+    , m_promptsAbandoned(false)
+{
+}
+
+PackageTransaction::~PackageTransaction()
+{
+    delete m_cacheFile;
+}
+
+QStringList PackageTransaction::installOrder() const
+{
+    return m_installOrder;
+}
+
+QStringList PackageTransaction::additionalPackages() const
+{
+    return m_additionalPackages;
+}
+
+QStringList PackageTransaction::removedPackages() const
+{
+    return m_removedPackages;
+}
+
+QString PackageTransaction::errorString() const
+{
+    return m_errorString;
+}
+
+QStringList PackageTransaction::summary() const
+{
+    return m_summary;
+}
+
+QVariantList PackageTransaction::timings() const
+{
+    return m_timeline.toVariantList();
+}
+
+void PackageTransaction::setOptions(const QVariantMap &options)
+{
+    m_deferTriggers = options.value("deferTriggers", true).toBool();
+    m_conffilePolicy = options.value("conffilePolicy", "keep").toString();
+    m_debconfSocket = options.value("debconfSocket").toString();
+    m_verify = options.value("verify", false).toBool();
+    m_root = TargetRoot::fromOptions(options);
+    m_profile = options.value("profile", "safe").toString();
+    m_cpuWeight = options.value("cpuWeight", 50).toInt();
+    m_ioWeight = options.value("ioWeight", 50).toInt();
+    m_memoryHigh = options.value("memoryHigh", 0).toLongLong();
+}
+
+void PackageTransaction::answerConffilePrompt(bool replace)
+{
+    // dpkg 的提示为 "(Y/I/N/O/D/Z) [default=N] ?"，Y 安装新版本，N 保留当前版本
+    QMutexLocker locker(&m_inputMutex);
+    if (m_inputFd >= 0 && m_conffilePending) {
+        const char *answer = replace ? "Y\n" : "N\n";
+        if (::write(m_inputFd, answer, 2) != 2) {
+            qWarning() << "Failed to answer conffile prompt";
+        }
+        m_conffilePending = false;
+        m_conffileAnswered.wakeAll();
+    }
+}
+
+void PackageTransaction::abandonPrompts()
+{
+    m_promptsAbandoned = true;
+    answerConffilePrompt(false);
+}
+
+// 在读取状态管道的线程中等待；dpkg 在回答之前不会再写入状态，不会丢失事件
+bool PackageTransaction::waitForConffileAnswer()
+{
+    QMutexLocker locker(&m_inputMutex);
+    QDeadlineTimer deadline(ConffileAnswerTimeout);
+    while (m_conffilePending) {
+        if (!m_conffileAnswered.wait(&m_inputMutex, deadline)) {
+            return !m_conffilePending;
+        }
+    }
+    return true;
+}
+
+void PackageTransaction::handleStatusEvent(const DpkgStatusParser::Event &event)
+{
+    if (event.type == DpkgStatusParser::Event::ConffilePrompt) {
+        {
+            QMutexLocker locker(&m_inputMutex);
+            m_conffilePending = true;
+        }
+
+        // 正常情况下 --force-confold/--force-confnew 已经避免了提示，这里兜底回答
+        if (m_conffilePolicy != "ask" || m_promptsAbandoned) {
+            answerConffilePrompt(m_conffilePolicy == "replace");
+        } else {
+            emit conffilePrompt(event.package);
+
+            // dpkg 等待回答期间一直持有锁，界面关闭或不再回答时不能无限等下去
+            if (!waitForConffileAnswer()) {
+                emit message(tr("No answer for the configuration file of %1, keeping the current version").arg(event.package));
+                answerConffilePrompt(false);
+            }
+        }
+    }
+
+    m_timeline.addEvent(event);
+}
+
+void PackageTransaction::summarizeProfile()
+{
+    // fsync 的开销主要落在解包阶段，在不同配置之间比较这两个时间即可看出效果
+    qint64 total = 0;
+    qint64 unpack = 0;
+    for (const InstallTimeline::Entry &entry : m_timeline.entries()) {
+        total += entry.duration;
+        if (entry.phase == "unpack") {
+            unpack += entry.duration;
+        }
+    }
+
+    m_summary << tr("Install profile %1: dpkg ran for %2 s, unpacking took %3 s")
+                 .arg(m_profile)
+                 .arg(total / 1000.0, 0, 'f', 1)
+                 .arg(unpack / 1000.0, 0, 'f', 1);
+}
+
+void PackageTransaction::summarizeTriggers(const QHash<QString, int> &activations)
+{
+    QStringList triggers;
+    qint64 total = 0;
+    qint64 saved = 0;
+
+    for (const InstallTimeline::Entry &entry : m_timeline.entries()) {
+        if (entry.phase != "trigger") {
+            continue;
+        }
+
+        const int avoided = activations.value(entry.package) - entry.runs;
+
+        triggers << entry.package;
+        total += entry.duration;
+        if (avoided > 0) {
+            saved += entry.duration / entry.runs * avoided;
+        }
+    }
+
+    m_summary << tr("Triggers processed once for all packages: %1 (%2 s)")
+                 .arg(triggers.join(", "))
+                 .arg(total / 1000.0, 0, 'f', 1);
+    m_summary << tr("Estimated time saved by deferring triggers: %1 s").arg(saved / 1000.0, 0, 'f', 1);
+}
+
+bool PackageTransaction::fail(const QString &message)
+{
+    m_errorString = message;
+
+    QString details = takeAptErrors();
+    if (!details.isEmpty()) {
+        m_errorString += "\n" + details;
+    }
+
+    return false;
+}
+
+pkgCache::VerIterator PackageTransaction::findVolatileVersion(const QString &debFile)
+{
+    // 读取 control 中的包名与架构，再找到来源为该文件的版本
+    FileFd fd(debFile.toStdString(), FileFd::ReadOnly);
+    debDebFile deb(fd);
+    debDebFile::MemControlExtract extract("control");
+    if (!extract.Read(deb)) {
+        return pkgCache::VerIterator();
+    }
+
+    std::string name = extract.Section.FindS("Package");
+    std::string arch = extract.Section.FindS("Architecture");
+    if (arch == "all") {
+        arch = _config->Find("APT::Architecture");
+    }
+
+    pkgCache::PkgIterator pkg = m_cacheFile->GetPkgCache()->FindPkg(name, arch);
+    if (pkg.end()) {
+        return pkgCache::VerIterator();
+    }
+
+    const std::string path = debFile.toStdString();
+    for (pkgCache::VerIterator ver = pkg.VersionList(); !ver.end(); ++ver) {
+        for (pkgCache::VerFileIterator vf = ver.FileList(); !vf.end(); ++vf) {
+            if (vf.File().FileName() != nullptr && path == vf.File().FileName()) {
+                return ver;
+            }
+        }
+    }
+
+    return pkgCache::VerIterator();
+}
+
+bool PackageTransaction::resolve(const QStringList &debFiles)
+{
+    m_debFiles = debFiles;
+    m_candidates.clear();
+    m_additionalPackages.clear();
+    m_removedPackages.clear();
+    m_installOrder.clear();
+    m_errorString.clear();
+
+    delete m_cacheFile;
+    m_cacheFile = new pkgCacheFile();
+
+    // 本地 deb 作为临时索引加入缓存，与仓库中的版本一起参与求解
+    if (!m_cacheFile->BuildSourceList()) {
+        return fail(tr("Failed to read APT sources"));
+    }
+
+    for (const QString &file : debFiles) {
+        if (!m_cacheFile->GetSourceList()->AddVolatileFile(file.toStdString())) {
+            return fail(tr("Failed to add %1 to APT cache").arg(file));
+        }
+    }
+
+    if (!m_cacheFile->Open(nullptr, false)) {
+        return fail(tr("Failed to open APT cache"));
+    }
+
+    pkgDepCache *depCache = m_cacheFile->GetDepCache();
+    pkgProblemResolver resolver(depCache);
+    QList<pkgCache::PkgIterator> packages;
+
+    for (const QString &file : debFiles) {
+        pkgCache::VerIterator ver = findVolatileVersion(file);
+        if (ver.end()) {
+            return fail(tr("Failed to find %1 in APT cache").arg(file));
+        }
+
+        pkgCache::PkgIterator pkg = ver.ParentPkg();
+        depCache->SetCandidateVersion(ver);
+        if (pkg.CurrentVer() == ver) {
+            depCache->SetReInstall(pkg, true);
+        } else {
+            depCache->MarkInstall(pkg, false);
+        }
+
+        resolver.Clear(pkg);
+        resolver.Protect(pkg);
+        m_candidates.insert(pkg->ID);
+        packages << pkg;
+    }
+
+    // 所有候选包都标记后再拉取依赖，候选包之间的依赖可以互相满足
+    for (const pkgCache::PkgIterator &pkg : packages) {
+        depCache->MarkInstall(pkg, true);
+    }
+
+    if (!resolver.Resolve(true) || depCache->BrokenCount() != 0) {
+        return fail(tr("Unable to resolve dependencies"));
+    }
+
+    for (pkgCache::PkgIterator pkg = m_cacheFile->GetPkgCache()->PkgBegin(); !pkg.end(); ++pkg) {
+        if (m_candidates.contains(pkg->ID)) {
+            continue;
+        }
+
+        pkgDepCache::StateCache &state = (*depCache)[pkg];
+        if (state.NewInstall() || state.Upgrade()) {
+            m_additionalPackages << QString::fromStdString(pkg.FullName(true));
+        } else if (state.Delete()) {
+            m_removedPackages << QString::fromStdString(pkg.FullName(true));
+        }
+    }
+
+    return planOrder();
+}
+
+bool PackageTransaction::planOrder()
+{
+    pkgCache *cache = m_cacheFile->GetPkgCache();
+    pkgDepCache *depCache = m_cacheFile->GetDepCache();
+
+    // 本次要安装的包：候选包与从仓库中拉取的依赖
+    QList<pkgCache::PkgIterator> nodes;
+    QHash<unsigned long, int> index;
+    for (pkgCache::PkgIterator pkg = cache->PkgBegin(); !pkg.end(); ++pkg) {
+        pkgDepCache::StateCache &state = (*depCache)[pkg];
+        if (state.NewInstall() || state.Upgrade() || state.Downgrade() || (state.iFlags & pkgDepCache::ReInstall)) {
+            index.insert(pkg->ID, nodes.size());
+            nodes << pkg;
+        }
+    }
+
+    // 边从被依赖的包指向依赖它的包；虚包经 AllTargets() 展开为提供者
+    struct Edge {
+        int to;
+        bool preDepends;
+    };
+    QList<QList<Edge>> edges(nodes.size());
+
+    for (int i = 0; i < nodes.size(); ++i) {
+        pkgCache::VerIterator ver = (*depCache)[nodes.at(i)].InstVerIter(*depCache);
+        for (pkgCache::DepIterator dep = ver.DependsList(); !dep.end(); ++dep) {
+            if (dep->Type != pkgCache::Dep::PreDepends && dep->Type != pkgCache::Dep::Depends) {
+                continue;
+            }
+
+            std::unique_ptr<pkgCache::Version *[]> targets(dep.AllTargets());
+            for (pkgCache::Version **target = targets.get(); *target; ++target) {
+                pkgCache::VerIterator targetVer(*cache, *target);
+                pkgCache::PkgIterator targetPkg = targetVer.ParentPkg();
+                auto it = index.constFind(targetPkg->ID);
+                if (it == index.constEnd() || it.value() == i || (*depCache)[targetPkg].InstVerIter(*depCache) != targetVer) {
+                    continue;
+                }
+                edges[it.value()] << Edge { i, dep->Type == pkgCache::Dep::PreDepends };
+            }
+        }
+    }
+
+    // Tarjan 强连通分量：一个分量在它能到达的所有分量之后产生，反过来即是安装顺序
+    QList<int> order(nodes.size(), -1);
+    QList<int> lowLink(nodes.size(), 0);
+    QList<bool> onStack(nodes.size(), false);
+    QList<int> stack;
+    QList<QList<int>> components;
+    int counter = 0;
+
+    std::function<void(int)> visit = [&](int v) {
+        order[v] = lowLink[v] = counter++;
+        stack << v;
+        onStack[v] = true;
+
+        for (const Edge &edge : edges.at(v)) {
+            if (order.at(edge.to) < 0) {
+                visit(edge.to);
+                lowLink[v] = qMin(lowLink.at(v), lowLink.at(edge.to));
+            } else if (onStack.at(edge.to)) {
+                lowLink[v] = qMin(lowLink.at(v), order.at(edge.to));
+            }
+        }
+
+        if (lowLink.at(v) == order.at(v)) {
+            QList<int> component;
+            int w;
+            do {
+                w = stack.takeLast();
+                onStack[w] = false;
+                component << w;
+            } while (w != v);
+            components << component;
+        }
+    };
+
+    for (int i = 0; i < nodes.size(); ++i) {
+        if (order.at(i) < 0) {
+            visit(i);
+        }
+    }
+
+    for (auto it = components.crbegin(); it != components.crend(); ++it) {
+        QSet<int> members(it->constBegin(), it->constEnd());
+        QStringList names;
+        for (int v : *it) {
+            names << QString::fromStdString(nodes.at(v).FullName(true));
+        }
+        std::sort(names.begin(), names.end());
+
+        // Depends 构成的环由 dpkg 先全部解包再一起配置；Pre-Depends 要求先配置好，环无法安装
+        for (int v : *it) {
+            for (const Edge &edge : edges.at(v)) {
+                if (edge.preDepends && members.contains(edge.to)) {
+                    return fail(tr("Pre-Depends cycle between %1").arg(names.join(", ")));
+                }
+            }
+        }
+
+        m_installOrder << names.join(" + ");
+    }
+
+    return true;
+}
+
+bool PackageTransaction::repair(const QString &debFile)
+{
+    m_errorString.clear();
+    m_summary.clear();
+
+    // 在特权进程中重新比较，不依赖客户端提供的文件列表
+    const InstalledFiles::Comparison comparison = InstalledFiles::compare(debFile, m_root);
+    if (comparison.state == InstalledFiles::Comparison::Unchanged) {
+        m_summary << tr("Installed files already match %1, nothing to do").arg(comparison.package);
+        return true;
+    }
+    if (comparison.state != InstalledFiles::Comparison::Modified) {
+        return fail(tr("%1 cannot be repaired, reinstall it instead").arg(QFileInfo(debFile).fileName()));
+    }
+
+    for (const QString &file : comparison.changedFiles) {
+        emit message(tr("Restoring %1").arg(file));
+    }
+
+    QStringList restored;
+    const QSet<QString> paths(comparison.changedFiles.constBegin(), comparison.changedFiles.constEnd());
+    if (!DebArchive::extractFiles(debFile, paths, &restored, m_root.rootDir(), m_profile != "ephemeral")) {
+        return fail(tr("Failed to restore files from %1").arg(QFileInfo(debFile).fileName()));
+    }
+
+    m_summary << tr("Restored %n file(s) of %1", "", restored.size()).arg(comparison.package);
+    return true;
+}
+
+bool PackageTransaction::commit()
+{
+    if (!m_cacheFile || !m_cacheFile->GetDepCache()) {
+        return fail(tr("Transaction has not been resolved"));
+    }
+
+    m_summary.clear();
+
+    // 记录开始安装时本地包有多少已在页缓存中，用于比较预读的效果
+    if (!m_debFiles.isEmpty()) {
+        double residency = 0;
+        for (const QString &file : m_debFiles) {
+            residency += PackagePrefetcher::residency(file);
+        }
+        m_summary << tr("Local packages in page cache at install start: %1%")
+                     .arg(qRound(residency * 100 / m_debFiles.size()));
+    }
+
+    // 多个包时推迟触发器，全部配置完成后只执行一次
+    const bool deferTriggers = m_deferTriggers && m_cacheFile->GetDepCache()->InstCount() > 1;
+
+    // dpkg 输出与 --status-fd 分别通过管道在单独的线程中读取；
+    // dpkg 的标准输入也改为管道，配置文件提示的回答从这里写入
+    int outputPipe[2] = { -1, -1 };
+    int statusPipe[2] = { -1, -1 };
+    int inputPipe[2] = { -1, -1 };
+    auto closePipes = [&]() {
+        for (int fd : { outputPipe[0], outputPipe[1], statusPipe[0], statusPipe[1], inputPipe[0], inputPipe[1] }) {
+            if (fd >= 0) {
+                ::close(fd);
+            }
+        }
+    };
+    if (::pipe2(outputPipe, O_CLOEXEC) != 0 || ::pipe2(statusPipe, O_CLOEXEC) != 0) {
+        closePipes();
+        return fail(tr("Failed to create output pipe"));
+    }
+    if (::pipe2(inputPipe, O_CLOEXEC) != 0) {
+        closePipes();
+        return fail(tr("Failed to create input pipe"));
+    }
+
+    // 服务整体的权重由 systemd 单元设为低于桌面会话，postinst 编译模块或重建缓存时桌面仍然流畅
+    InstallCgroup::Limits limits;
+    limits.cpuWeight = m_cpuWeight;
+    limits.ioWeight = m_ioWeight;
+    limits.memoryHigh = m_memoryHigh;
+    InstallCgroup cgroup;
+    if (!cgroup.create(limits)) {
+        emit message(tr("No delegated cgroup v2 is available, installing without resource limits"));
+    }
+
+    // APT 在下载与 dpkg 运行期间一直读取 _config，换成本事务自己的配置副本。
+    // 所有选项都在交给 Pin 之前写好，之后同一目标的 Scope 会并发读取它
+    Configuration *config = m_root.copyConfiguration();
+
+    // 本地 file:/copy: 源与网络源在多个队列中并行获取
+    config->Set("Acquire::QueueHost::Limit", QThread::idealThreadCount());
+
+    if (deferTriggers) {
+        config->Set("DPkg::NoTriggers", "true");
+        config->Set("DPkg::ConfigurePending", "true");
+        config->Set("DPkg::TriggersPending", "true");
+    }
+
+    // 状态管道的写端、输出管道的写端与输入管道的读端需要被 dpkg 继承
+    for (int fd : { statusPipe[1], outputPipe[1], inputPipe[0] }) {
+        config->Set("APT::Keep-Fds::", std::to_string(fd));
+    }
+    config->Set("DPkg::Options::", "--status-fd=" + std::to_string(statusPipe[1]));
+
+    // APT 通过 ExecFork() 启动 dpkg，不会调用进度对象的 fork()。dpkg 的标准输入输出、环境变量、优先级与 cgroup
+    // 由启动器在 fork 出的子进程中设置后再 exec 真正的 dpkg，本进程的其它线程不受影响
+    config->Set("DPkg::Options::", "--debinstaller-dpkg=" + config->Find("Dir::Bin::dpkg", "dpkg"));
+    config->Set("Dir::Bin::dpkg", DPKG_LAUNCHER);
+
+    // dpkg 与维护脚本的输出经管道送到 output 信号，配置文件提示的回答从输入管道读取
+    config->Set("DPkg::Options::", "--debinstaller-output=" + std::to_string(outputPipe[1]));
+    config->Set("DPkg::Options::", "--debinstaller-stdin=" + std::to_string(inputPipe[0]));
+
+    // debconf 问题交给内置前端，没有前端时使用默认值
+    if (m_debconfSocket.isEmpty()) {
+        config->Set("DPkg::Options::", "--debinstaller-setenv=DEBIAN_FRONTEND=noninteractive");
+    } else {
+        config->Set("DPkg::Options::", "--debinstaller-setenv=DEBIAN_FRONTEND=passthrough");
+        config->Set("DPkg::Options::", "--debinstaller-setenv=DEBCONF_PIPE=" + m_debconfSocket.toStdString());
+    }
+
+    // fast: 以较低的 CPU 与 IO 优先级在后台安装
+    if (m_profile == "fast") {
+        config->Set("DPkg::Options::", "--debinstaller-background");
+    }
+
+    // 只有启动器 fork 出的 dpkg 进入 cgroup，本进程留在 main 子组中
+    if (cgroup.isValid()) {
+        config->Set("DPkg::Options::", "--debinstaller-cgroup=" + cgroup.path().toStdString());
+    }
+
+    // 不使用伪终端，否则 APT 会在子进程中覆盖上面的重定向
+    config->Set("Dpkg::Use-Pty", "false");
+
+    if (m_conffilePolicy == "keep") {
+        config->Set("DPkg::Options::", "--force-confdef");
+        config->Set("DPkg::Options::", "--force-confold");
+    } else if (m_conffilePolicy == "replace") {
+        config->Set("DPkg::Options::", "--force-confnew");
+    }
+
+    // ephemeral: 用完即弃的虚拟机与容器，dpkg 解包时不再逐个文件 fsync
+    if (m_profile == "ephemeral") {
+        config->Set("DPkg::Options::", "--force-unsafe-io");
+    }
+
+    // 安装配置同时写入 APT 的 history.log
+    config->Set("CommandLine::AsString", QString("cutefish-debinstaller --profile=%1 %2")
+                .arg(m_profile, m_debFiles.join(' ')).toStdString());
+
+    TargetRoot::Pin pin(m_root, config);
+
+    if (!_system->Lock()) {
+        closePipes();
+        return fail(tr("Unable to lock the package database"));
+    }
+
+    AcquireStatus status(this);
+    pkgAcquire fetcher(&status);
+    if (!fetcher.GetLock(_config->FindDir("Dir::Cache::Archives"))) {
+        _system->UnLock();
+        closePipes();
+        return fail(tr("Unable to lock the download directory"));
+    }
+
+    // 已在 /var/cache/apt/archives 中的包不会重复下载
+    pkgRecords records(*m_cacheFile);
+    std::unique_ptr<pkgPackageManager> packageManager(_system->CreatePM(m_cacheFile->GetDepCache()));
+    if (!packageManager->GetArchives(&fetcher, m_cacheFile->GetSourceList(), &records)) {
+        _system->UnLock();
+        closePipes();
+        return fail(tr("Failed to prepare package downloads"));
+    }
+
+    if (fetcher.Run() != pkgAcquire::Continue) {
+        _system->UnLock();
+        closePipes();
+        return fail(tr("Download was interrupted"));
+    }
+
+    for (auto it = fetcher.ItemsBegin(); it != fetcher.ItemsEnd(); ++it) {
+        if ((*it)->Status != pkgAcquire::Item::StatDone || !(*it)->Complete) {
+            _system->UnLock();
+            closePipes();
+            return fail(tr("Failed to fetch %1: %2")
+                        .arg(QString::fromStdString((*it)->DescURI()))
+                        .arg(QString::fromStdString((*it)->ErrorText)));
+        }
+    }
+
+    QStringList archives = m_debFiles;
+    for (auto it = fetcher.ItemsBegin(); it != fetcher.ItemsEnd(); ++it) {
+        if (!(*it)->DestFile.empty()) {
+            archives << QString::fromStdString((*it)->DestFile);
+        }
+    }
+
+    // 与安装并行统计每个触发器原本会被激活的次数
+    QFuture<QHash<QString, int>> activations;
+    if (deferTriggers) {
+        activations = QtConcurrent::run(countTriggerActivations, archives, m_root.adminDir());
+    }
+
+    {
+        QMutexLocker locker(&m_inputMutex);
+        m_inputFd = inputPipe[1];
+    }
+
+    emit message(tr("Install profile: %1").arg(m_profile));
+    if (m_installOrder.size() > 1) {
+        emit message(tr("Install order: %1").arg(m_installOrder.join(", ")));
+    }
+
+    QThread *outputReader = QThread::create([this, fd = outputPipe[0]]() {
+        char buffer[4096];
+        ssize_t size;
+        while ((size = ::read(fd, buffer, sizeof(buffer))) > 0) {
+            emit output(QString::fromLocal8Bit(buffer, size));
+        }
+    });
+    outputReader->start();
+
+    m_timeline = InstallTimeline();
+    QThread *statusReader = QThread::create([this, fd = statusPipe[0]]() {
+        DpkgStatusParser parser;
+        char buffer[4096];
+        ssize_t size;
+        while ((size = ::read(fd, buffer, sizeof(buffer))) > 0) {
+            parser.feed(QByteArray(buffer, size));
+            for (const DpkgStatusParser::Event &event : parser.takeEvents()) {
+                handleStatusEvent(event);
+            }
+        }
+        m_timeline.finish(parser.elapsed());
+    });
+    statusReader->start();
+
+    // 下载方法进程已经启动过，此时才让这几个描述符跨过 exec，免得被它们继承而读不到 EOF
+    for (int fd : { statusPipe[1], outputPipe[1], inputPipe[0] }) {
+        ::fcntl(fd, F_SETFD, 0);
+    }
+
+    // 持有前端锁，释放内部锁让 dpkg 获取；多个包的顺序由 pkgPackageManager 决定
+    _system->UnLockInner();
+
+    InstallProgress progress(this);
+    const pkgPackageManager::OrderResult result = packageManager->DoInstall(&progress);
+    _system->LockInner();
+    _system->UnLock();
+
+    // dpkg 已经退出，不再等待提示的回答
+    {
+        QMutexLocker locker(&m_inputMutex);
+        m_inputFd = -1;
+        m_conffilePending = false;
+        m_conffileAnswered.wakeAll();
+    }
+    ::close(inputPipe[0]);
+    ::close(inputPipe[1]);
+
+    ::close(outputPipe[1]);
+    ::close(statusPipe[1]);
+    outputReader->wait();
+    statusReader->wait();
+    delete outputReader;
+    delete statusReader;
+    ::close(outputPipe[0]);
+    ::close(statusPipe[0]);
+
+    if (deferTriggers) {
+        summarizeTriggers(activations.result());
+    }
+    summarizeProfile();
+    if (cgroup.isValid()) {
+        m_summary << cgroup.usageSummary();
+    }
+
+    if (result != pkgPackageManager::Completed) {
+        return fail(tr("Installation failed"));
+    }
+
+    if (m_verify) {
+        return verifyInstalled(archives);
+    }
+
+    return true;
+}
+
+bool PackageTransaction::verifyInstalled(const QStringList &archives)
+{
+    emit progressChanged(100, tr("Verifying installed files"));
+
+    QElapsedTimer timer;
+    timer.start();
+
+    // 所有包的文件一起校验，一个大包不会让其它核心空闲
+    QStringList mismatched;
+    int checked = 0;
+    for (const InstalledFiles::Comparison &comparison : InstalledFiles::compareAll(archives, m_root)) {
+        // 没有 md5sums 的包无法校验
+        if (comparison.state == InstalledFiles::Comparison::NotComparable) {
+            emit message(tr("Skipping verification of %1: no checksums").arg(comparison.package));
+            continue;
+        }
+        if (comparison.state == InstalledFiles::Comparison::NotInstalled) {
+            return fail(tr("%1 is not installed after the transaction").arg(comparison.package));
+        }
+
+        mismatched << comparison.changedFiles;
+        checked += comparison.checkedFiles;
+    }
+
+    if (!mismatched.isEmpty()) {
+        return fail(tr("%n installed file(s) do not match the package:", "", mismatched.size())
+                    + "\n" + mismatched.join('\n'));
+    }
+
+    m_summary << tr("Verified %n installed file(s) in %1 s", "", checked).arg(timer.elapsed() / 1000.0, 0, 'f', 1);
+    return true;
+}
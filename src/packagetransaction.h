@@ -0,0 +1,130 @@
+/*
+ * Copyright (C) 2021 Cutefish Technology Co., Ltd.
+ *
+ * Author:     Reion Wong <reion@cutefishos.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef PACKAGETRANSACTION_H
+#define PACKAGETRANSACTION_H
+
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QSet>
+#include <QHash>
+#include <QVariantMap>
+#include <QMutex>
+#include <QWaitCondition>
+
+#include <atomic>
+
+#include "dpkgstatusparser.h"
+#include "installtimeline.h"
+#include "targetroot.h"
+
+#include <apt-pkg/cachefile.h>
+#include <apt-pkg/pkgcache.h>
+
+// 把本地 deb 与仓库中缺失的依赖放进同一个 APT 事务
+// resolve() 和 commit() 都是阻塞调用，应在工作线程中执行；
+// resolve() 需在该目标的 TargetRoot::Scope 内调用，commit() 自己固定配置，不能在 Scope 内调用
+class PackageTransaction : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit PackageTransaction(QObject *parent = nullptr);
+    ~PackageTransaction();
+
+    bool resolve(const QStringList &debFiles);
+    bool commit();
+
+    // 已安装同一版本时只恢复内容与包不同的文件，不运行 dpkg；需持有 dpkg 锁
+    bool repair(const QString &debFile);
+
+    // deferTriggers: 多包安装时推迟触发器，最后统一执行一次
+    // conffilePolicy: 配置文件冲突时 "keep"、"replace" 或 "ask"
+    // debconfSocket: debconf passthrough 前端的套接字，为空时使用默认值回答
+    // verify: 安装完成后校验已安装文件与包中的 md5sums 是否一致
+    // rootDir、adminDir: 安装目标，见 TargetRoot
+    // profile: "safe"（默认）、"fast"（以较低的 CPU 与 IO 优先级在后台安装）
+    //          或 "ephemeral"（--force-unsafe-io，用于用完即弃的虚拟机与容器）
+    // cpuWeight、ioWeight、memoryHigh: dpkg 子进程所在 cgroup 的限制，见 InstallCgroup
+    void setOptions(const QVariantMap &options);
+
+    // 回答 conffilePrompt()，可在任意线程调用；没有等待回答的提示时忽略。
+    // 限定时间内没有回答时保留当前版本
+    void answerConffilePrompt(bool replace);
+
+    // 提问的客户端已经断开：保留当前版本回答正在等待的提示，之后的提示不再提问，可在任意线程调用
+    void abandonPrompts();
+
+    QStringList additionalPackages() const;
+    QStringList removedPackages() const;
+    // resolve() 之后所有要安装的包的顺序，被依赖的包在前；
+    // 只由 Depends 构成的环（需要一起配置）以 " + " 连接为一项
+    QStringList installOrder() const;
+    QString errorString() const;
+    QStringList summary() const;
+    // 每个包每个阶段的耗时，见 InstallTimeline
+    QVariantList timings() const;
+
+signals:
+    void message(const QString &text);
+    void output(const QString &text);
+    void progressChanged(double percent, const QString &action);
+    void conffilePrompt(const QString &conffile);
+
+private:
+    bool fail(const QString &message);
+    pkgCache::VerIterator findVolatileVersion(const QString &debFile);
+    bool planOrder();
+    bool verifyInstalled(const QStringList &archives);
+    void handleStatusEvent(const DpkgStatusParser::Event &event);
+    bool waitForConffileAnswer();
+    void summarizeTriggers(const QHash<QString, int> &activations);
+    void summarizeProfile();
+
+private:
+    pkgCacheFile *m_cacheFile;
+
+    QStringList m_debFiles;
+    QSet<unsigned long> m_candidates;
+    QStringList m_additionalPackages;
+    QStringList m_removedPackages;
+    QStringList m_installOrder;
+    QString m_errorString;
+    QStringList m_summary;
+
+    bool m_deferTriggers;
+    QString m_conffilePolicy;
+    QString m_debconfSocket;
+    bool m_verify;
+    TargetRoot m_root;
+    QString m_profile;
+    int m_cpuWeight;
+    int m_ioWeight;
+    qint64 m_memoryHigh;
+
+    QMutex m_inputMutex;
+    QWaitCondition m_conffileAnswered;
+    int m_inputFd;
+    bool m_conffilePending;
+    std::atomic<bool> m_promptsAbandoned;
+
+    InstallTimeline m_timeline;
+};
+
+#endif // PACKAGETRANSACTION_H
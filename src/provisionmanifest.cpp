@@ -0,0 +1,154 @@
+/*
+ * Copyright (C) 2021 Cutefish Technology Co., Ltd.
+ *
+ * Author:     Reion Wong <reion@cutefishos.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "provisionmanifest.h"
+#include "debarchive.h"
+#include "dpkgstatuswatcher.h"
+#include "installedfiles.h"
+#include <QCryptographicHash>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QThreadPool>
+#include <QtConcurrent/QtConcurrent>
+
+#include <apt-pkg/debversion.h>
+#include <apt-pkg/error.h>
+
+namespace {
+
+QString sha256sum(const QString &path)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return QString();
+    }
+
+    QCryptographicHash hash(QCryptographicHash::Sha256);
+    hash.addData(&file);
+    return QString::fromLatin1(hash.result().toHex());
+}
+
+}
+
+bool ProvisionManifest::load(const QString &manifestFile, QList<Entry> &entries, QString &errorString)
+{
+    QFile file(manifestFile);
+    if (!file.open(QIODevice::ReadOnly)) {
+        errorString = tr("Cannot read %1: %2").arg(manifestFile, file.errorString());
+        return false;
+    }
+
+    QJsonParseError parseError;
+    const QJsonDocument document = QJsonDocument::fromJson(file.readAll(), &parseError);
+    if (parseError.error != QJsonParseError::NoError) {
+        errorString = tr("Invalid manifest %1: %2").arg(manifestFile, parseError.errorString());
+        return false;
+    }
+
+    const QDir baseDir = QFileInfo(manifestFile).absoluteDir();
+    const QJsonArray packages = document.object().value("packages").toArray();
+    for (const QJsonValue &value : packages) {
+        const QJsonObject object = value.toObject();
+
+        Entry entry;
+        entry.file = QDir::cleanPath(baseDir.absoluteFilePath(object.value("file").toString()));
+        entry.sha256 = object.value("sha256").toString().toLower();
+        entry.minVersion = object.value("minVersion").toString();
+
+        if (object.value("file").toString().isEmpty() || entry.sha256.size() != 64) {
+            errorString = tr("Invalid manifest %1: every package needs a file and a SHA256").arg(manifestFile);
+            return false;
+        }
+
+        entries << entry;
+    }
+
+    if (entries.isEmpty()) {
+        errorString = tr("Manifest %1 lists no packages").arg(manifestFile);
+        return false;
+    }
+
+    return true;
+}
+
+void ProvisionManifest::check(QList<Entry> &entries, const TargetRoot &root)
+{
+    // 只读取一次 dpkg 状态，各线程共享
+    const DpkgStatusWatcher::Snapshot installed = DpkgStatusWatcher::parseStatusFile(root.adminDir() + "/status");
+
+    // 计算校验和的线程数取决于清单中的包所在的设备
+    QThreadPool pool;
+    pool.setMaxThreadCount(InstalledFiles::hashThreadCount(QFileInfo(entries.first().file).absolutePath()));
+
+    QtConcurrent::blockingMap(&pool, entries, [&installed](Entry &entry) {
+        const QString sha256 = sha256sum(entry.file);
+        if (sha256.isEmpty()) {
+            entry.errorString = tr("Cannot read %1").arg(entry.file);
+            return;
+        }
+        if (sha256 != entry.sha256) {
+            entry.errorString = tr("SHA256 of %1 does not match the manifest").arg(entry.file);
+            return;
+        }
+
+        const QByteArray control = DebArchive::controlMember(entry.file, "control");
+
+        // _error 按线程保存，不清除会让同一线程的下一个包也失败
+        _error->Discard();
+
+        entry.package = DebArchive::controlField(control, "Package");
+        entry.version = DebArchive::controlField(control, "Version");
+        if (entry.package.isEmpty() || entry.version.isEmpty()) {
+            entry.errorString = tr("%1 is not a valid Debian package").arg(entry.file);
+            return;
+        }
+
+        const QString required = entry.minVersion.isEmpty() ? entry.version : entry.minVersion;
+        if (debVS.CmpVersion(entry.version.toStdString(), required.toStdString()) < 0) {
+            entry.errorString = tr("%1 %2 is older than the required version %3")
+                    .arg(entry.package, entry.version, required);
+            return;
+        }
+
+        const DpkgStatusWatcher::PackageState state = installed.value(entry.package);
+        if (state.isInstalled()) {
+            entry.installedVersion = state.version;
+        }
+
+        entry.action = state.isInstalled() && debVS.CmpVersion(state.version.toStdString(), required.toStdString()) >= 0
+                ? Entry::Skip
+                : Entry::Install;
+    });
+}
+
+QString ProvisionManifest::actionName(Entry::Action action)
+{
+    switch (action) {
+    case Entry::Install:
+        return "install";
+    case Entry::Skip:
+        return "skip";
+    case Entry::Error:
+        break;
+    }
+    return "error";
+}
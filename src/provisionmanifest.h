@@ -0,0 +1,63 @@
+/*
+ * Copyright (C) 2021 Cutefish Technology Co., Ltd.
+ *
+ * Author:     Reion Wong <reion@cutefishos.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef PROVISIONMANIFEST_H
+#define PROVISIONMANIFEST_H
+
+#include <QCoreApplication>
+#include <QString>
+#include <QList>
+
+#include "targetroot.h"
+
+// 批量部署用的清单：每个包的路径、期望的 SHA256 与要求的最低版本。格式为
+// {"packages": [{"file": "a.deb", "sha256": "...", "minVersion": "1.2"}]}，
+// 相对路径以清单所在目录为准。已安装的版本满足要求时跳过，重复执行不会重新安装
+class ProvisionManifest
+{
+    Q_DECLARE_TR_FUNCTIONS(ProvisionManifest)
+
+public:
+    struct Entry {
+        enum Action {
+            Install,
+            Skip,    // 已安装的版本满足要求
+            Error,   // 无法读取、校验和不符或包的版本低于要求
+        };
+
+        QString file;
+        QString sha256;      // 小写十六进制
+        QString minVersion;  // 为空时要求不低于包本身的版本
+
+        // 以下由 check() 填写
+        QString package;
+        QString version;
+        QString installedVersion;
+        Action action = Error;
+        QString errorString;
+    };
+
+    static bool load(const QString &manifestFile, QList<Entry> &entries, QString &errorString);
+
+    // 并行计算 SHA256 并读取控制信息，再与目标中已安装的版本比较
+    static void check(QList<Entry> &entries, const TargetRoot &root);
+
+    static QString actionName(Entry::Action action);
+};
+
+#endif // PROVISIONMANIFEST_H
@@ -0,0 +1,322 @@
+/*
+ * Copyright (C) 2021 Cutefish Technology Co., Ltd.
+ *
+ * Author:     Reion Wong <reion@cutefishos.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "remotepackage.h"
+#include <QCryptographicHash>
+#include <QDir>
+#include <QNetworkAccessManager>
+#include <QNetworkReply>
+#include <QNetworkRequest>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QTimer>
+
+namespace {
+
+// 第一次请求的大小，通常已包含 debian-binary 与完整的 control.tar
+const qint64 HeadRequestSize = 64 * 1024;
+
+const int MaximumRetries = 5;
+const int RetryDelay = 2000;
+
+// ar 成员头：名称 16、修改时间 12、uid 6、gid 6、模式 8、大小 10、结束标记 2
+const int ArHeaderSize = 60;
+
+// 返回 control 成员结束的位置；数据还不够时返回 0，不是 deb 时返回 -1
+qint64 findControlEnd(const QByteArray &data)
+{
+    if (data.size() < 8) {
+        return 0;
+    }
+    if (!data.startsWith("!<arch>\n")) {
+        return -1;
+    }
+
+    qint64 pos = 8;
+    while (pos + ArHeaderSize <= data.size()) {
+        const QByteArray name = data.mid(pos, 16).trimmed();
+        bool ok = false;
+        const qint64 size = data.mid(pos + 48, 10).trimmed().toLongLong(&ok);
+        if (!ok || data.mid(pos + 58, 2) != "`\n") {
+            return -1;
+        }
+
+        const qint64 end = pos + ArHeaderSize + size;
+        if (name.startsWith("control.tar")) {
+            return end <= data.size() ? end : 0;
+        }
+        if (name.startsWith("data.tar")) {
+            return -1;
+        }
+
+        // 成员按偶数字节对齐
+        pos = end + (end & 1);
+    }
+
+    return 0;
+}
+
+QByteArray arHeader(const QByteArray &name, qint64 size)
+{
+    return name.leftJustified(16, ' ')
+            + QByteArray("0").leftJustified(12, ' ')
+            + QByteArray("0").leftJustified(6, ' ')
+            + QByteArray("0").leftJustified(6, ' ')
+            + QByteArray("100644").leftJustified(8, ' ')
+            + QByteArray::number(size).leftJustified(10, ' ')
+            + "`\n";
+}
+
+}
+
+RemotePackage::RemotePackage(QObject *parent)
+    : QObject(parent)
+    , m_network(new QNetworkAccessManager(this))
+    , m_reply(nullptr)
+    , m_controlReady(false)
+    , m_requestFrom(0)
+    , m_rangeLimited(false)
+    , m_total(-1)
+    , m_retries(0)
+{
+}
+
+bool RemotePackage::isRemote(const QString &fileName)
+{
+    return fileName.startsWith("http://") || fileName.startsWith("https://");
+}
+
+void RemotePackage::fetch(const QUrl &url)
+{
+    cancel();
+
+    m_url = url;
+    m_head.clear();
+    m_controlReady = false;
+    m_total = -1;
+    m_retries = 0;
+
+    // 同一地址的下载保存在固定位置，重新打开时从 .part 续传
+    const QString dir = QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/downloads";
+    QDir().mkpath(dir);
+
+    QString name = url.fileName();
+    if (!name.endsWith(".deb")) {
+        name = "package.deb";
+    }
+    const QString prefix = QString("%1/%2-").arg(dir, QString::fromLatin1(
+            QCryptographicHash::hash(url.toEncoded(), QCryptographicHash::Sha1).toHex().left(12)));
+    m_localFile = prefix + name;
+    m_stubFile = prefix + "control-" + name;
+
+    m_file.setFileName(m_localFile + ".part");
+    if (!m_file.open(QIODevice::ReadWrite | QIODevice::Append)) {
+        fail(tr("Failed to write %1").arg(m_file.fileName()));
+        return;
+    }
+
+    // 已有部分下载时先从中解析控制信息
+    if (m_file.size() > 0) {
+        m_file.seek(0);
+        m_head = m_file.read(16 * HeadRequestSize);
+        parseControl();
+        if (!m_file.isOpen()) {
+            return;
+        }
+    }
+
+    const qint64 size = m_file.size();
+    request(size, size == 0 ? HeadRequestSize - 1 : -1);
+}
+
+void RemotePackage::cancel()
+{
+    if (m_reply) {
+        m_reply->disconnect(this);
+        m_reply->abort();
+        m_reply->deleteLater();
+        m_reply = nullptr;
+    }
+
+    if (m_file.isOpen()) {
+        m_file.close();
+    }
+}
+
+QUrl RemotePackage::url() const
+{
+    return m_url;
+}
+
+bool RemotePackage::isDownloading() const
+{
+    return m_file.isOpen();
+}
+
+void RemotePackage::request(qint64 from, qint64 to)
+{
+    QNetworkRequest request(m_url);
+    request.setAttribute(QNetworkRequest::RedirectPolicyAttribute, QNetworkRequest::NoLessSafeRedirectPolicy);
+    if (from > 0 || to >= 0) {
+        request.setRawHeader("Range", "bytes=" + QByteArray::number(from) + "-"
+                             + (to >= 0 ? QByteArray::number(to) : QByteArray()));
+    }
+
+    m_requestFrom = from;
+    m_rangeLimited = to >= 0;
+
+    m_reply = m_network->get(request);
+    connect(m_reply, &QNetworkReply::metaDataChanged, this, &RemotePackage::onMetaDataChanged);
+    connect(m_reply, &QNetworkReply::readyRead, this, &RemotePackage::onReadyRead);
+    connect(m_reply, &QNetworkReply::finished, this, &RemotePackage::onFinished);
+}
+
+void RemotePackage::onMetaDataChanged()
+{
+    const int status = m_reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+
+    if (status == 206) {
+        // Content-Range: bytes <起始>-<结束>/<总大小或 *>
+        const QByteArray range = m_reply->rawHeader("Content-Range");
+        const int slash = range.indexOf('/');
+        m_total = slash > 0 && range.mid(slash + 1) != "*" ? range.mid(slash + 1).toLongLong() : -1;
+    } else if (status == 200) {
+        // 服务器不支持范围请求，返回的是整个文件，从头写入
+        m_file.resize(0);
+        if (!m_controlReady) {
+            m_head.clear();
+        }
+        m_requestFrom = 0;
+        m_rangeLimited = false;
+
+        const QVariant length = m_reply->header(QNetworkRequest::ContentLengthHeader);
+        m_total = length.isValid() ? length.toLongLong() : -1;
+    }
+}
+
+void RemotePackage::onReadyRead()
+{
+    // 错误页面与重定向的内容不属于包
+    const int status = m_reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    if (status != 200 && status != 206) {
+        return;
+    }
+
+    const QByteArray data = m_reply->readAll();
+    if (m_file.write(data) != data.size()) {
+        fail(tr("Failed to write %1").arg(m_file.fileName()));
+        return;
+    }
+
+    if (!m_controlReady) {
+        m_head.append(data);
+        parseControl();
+        if (!m_file.isOpen()) {
+            return;
+        }
+    }
+
+    emit progressChanged(m_file.size(), m_total);
+}
+
+void RemotePackage::onFinished()
+{
+    QNetworkReply *reply = m_reply;
+    m_reply = nullptr;
+    reply->deleteLater();
+
+    const int status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    const bool complete = (reply->error() == QNetworkReply::NoError
+                           && (m_total >= 0 ? m_file.size() >= m_total : !m_rangeLimited))
+            // 续传时文件其实已经完整
+            || (status == 416 && m_file.size() > 0);
+
+    if (complete) {
+        m_file.close();
+        if (!m_controlReady) {
+            fail(tr("Not a valid Debian package"));
+            return;
+        }
+
+        QFile::remove(m_localFile);
+        if (!QFile::rename(m_file.fileName(), m_localFile)) {
+            fail(tr("Failed to write %1").arg(m_localFile));
+            return;
+        }
+
+        emit finished(m_localFile);
+        QFile::remove(m_stubFile);
+        return;
+    }
+
+    // 第一次只请求了开头，接着下载剩余部分
+    if (reply->error() == QNetworkReply::NoError) {
+        m_retries = 0;
+        request(m_file.size());
+        return;
+    }
+
+    // 4xx 除超时与限流外重试也不会成功
+    if ((status >= 400 && status < 500 && status != 408 && status != 429) || ++m_retries > MaximumRetries) {
+        fail(tr("Download failed: %1").arg(reply->errorString()));
+        return;
+    }
+
+    const QUrl url = m_url;
+    QTimer::singleShot(RetryDelay * m_retries, this, [this, url]() {
+        if (m_url == url && m_file.isOpen() && !m_reply) {
+            request(m_file.size());
+        }
+    });
+}
+
+void RemotePackage::parseControl()
+{
+    const qint64 end = findControlEnd(m_head);
+    if (end == 0) {
+        return;
+    }
+    if (end < 0) {
+        fail(tr("Not a valid Debian package"));
+        return;
+    }
+
+    // 占位包：原有的 debian-binary 与 control 成员，加上一个空的 data.tar
+    QByteArray stub = m_head.left(end);
+    if (end & 1) {
+        stub.append('\n');
+    }
+    const QByteArray emptyTar(10240, '\0');
+    stub += arHeader("data.tar", emptyTar.size()) + emptyTar;
+
+    QSaveFile file(m_stubFile);
+    if (!file.open(QIODevice::WriteOnly) || file.write(stub) != stub.size() || !file.commit()) {
+        fail(tr("Failed to write %1").arg(m_stubFile));
+        return;
+    }
+
+    m_controlReady = true;
+    m_head.clear();
+    emit controlReady(m_stubFile);
+}
+
+void RemotePackage::fail(const QString &errorString)
+{
+    cancel();
+    emit failed(errorString);
+}
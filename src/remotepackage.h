@@ -0,0 +1,84 @@
+/*
+ * Copyright (C) 2021 Cutefish Technology Co., Ltd.
+ *
+ * Author:     Reion Wong <reion@cutefishos.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef REMOTEPACKAGE_H
+#define REMOTEPACKAGE_H
+
+#include <QObject>
+#include <QUrl>
+#include <QFile>
+#include <QByteArray>
+
+class QNetworkAccessManager;
+class QNetworkReply;
+
+// 从 http(s) 地址打开 deb：第一次范围请求取得 ar 头与 control.tar，
+// 据此生成只含控制信息的占位包用于显示信息与检查依赖；完整文件在后台继续下载，
+// 网络中断或重新打开同一地址时从已下载的位置续传
+class RemotePackage : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit RemotePackage(QObject *parent = nullptr);
+
+    static bool isRemote(const QString &fileName);
+
+    // 取消上一次下载并开始新的下载
+    void fetch(const QUrl &url);
+    void cancel();
+
+    QUrl url() const;
+    bool isDownloading() const;
+
+signals:
+    // 占位包只能用于读取控制信息，data.tar 为空
+    void controlReady(const QString &stubFile);
+    // total 未知时为 -1
+    void progressChanged(qint64 received, qint64 total);
+    void finished(const QString &localFile);
+    void failed(const QString &errorString);
+
+private slots:
+    void onMetaDataChanged();
+    void onReadyRead();
+    void onFinished();
+
+private:
+    void request(qint64 from, qint64 to = -1);
+    void parseControl();
+    void fail(const QString &errorString);
+
+private:
+    QNetworkAccessManager *m_network;
+    QNetworkReply *m_reply;
+
+    QUrl m_url;
+    QFile m_file;
+    QString m_localFile;
+    QString m_stubFile;
+
+    QByteArray m_head;       // 找到 control 成员之前已下载的数据
+    bool m_controlReady;
+    qint64 m_requestFrom;
+    bool m_rangeLimited;
+    qint64 m_total;
+    int m_retries;
+};
+
+#endif // REMOTEPACKAGE_H
@@ -0,0 +1,110 @@
+/*
+ * Copyright (C) 2021 Cutefish Technology Co., Ltd.
+ *
+ * Author:     Reion Wong <reion@cutefishos.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "repositorycheck.h"
+#include "debarchive.h"
+#include <QCryptographicHash>
+#include <QFile>
+#include <QFileInfo>
+
+#include <apt-pkg/cachefile.h>
+#include <apt-pkg/configuration.h>
+#include <apt-pkg/error.h>
+#include <apt-pkg/hashes.h>
+#include <apt-pkg/pkgrecords.h>
+
+#include <memory>
+
+RepositoryCheck::Result RepositoryCheck::check(const QString &debFile, const TargetRoot &root)
+{
+    Result result;
+
+    const QByteArray control = DebArchive::controlMember(debFile, "control");
+    _error->Discard();
+
+    result.package = DebArchive::controlField(control, "Package");
+    const std::string version = DebArchive::controlField(control, "Version").toStdString();
+    std::string arch = DebArchive::controlField(control, "Architecture").toStdString();
+    if (result.package.isEmpty()) {
+        return result;
+    }
+
+    std::string expectedHash;
+    unsigned long long expectedSize = 0;
+
+    {
+        // 只读打开目标的缓存，不持有 dpkg 锁
+        TargetRoot::Scope scope(root);
+
+        pkgCacheFile cacheFile;
+        if (!cacheFile.Open(nullptr, false)) {
+            _error->Discard();
+            return result;
+        }
+
+        if (arch == "all") {
+            arch = _config->Find("APT::Architecture");
+        }
+
+        pkgCache::PkgIterator pkg = cacheFile.GetPkgCache()->FindPkg(result.package.toStdString(), arch);
+        if (pkg.end()) {
+            return result;
+        }
+
+        pkgRecords records(cacheFile);
+        for (pkgCache::VerIterator ver = pkg.VersionList(); !ver.end() && expectedHash.empty(); ++ver) {
+            if (version != ver.VerStr()) {
+                continue;
+            }
+
+            // dpkg status 不是软件源，没有文件的校验和
+            for (pkgCache::VerFileIterator vf = ver.FileList(); !vf.end(); ++vf) {
+                if (vf.File().Flagged(pkgCache::Flag::NotSource)) {
+                    continue;
+                }
+
+                const HashString *sha256 = records.Lookup(vf).Hashes().find("SHA256");
+                if (sha256 != nullptr) {
+                    expectedHash = sha256->HashValue();
+                    expectedSize = ver->Size;
+                    result.archive = QString::fromUtf8(vf.File().Archive() ? vf.File().Archive() : "");
+                    break;
+                }
+            }
+        }
+    }
+
+    if (expectedHash.empty()) {
+        return result;
+    }
+
+    if (QFileInfo(debFile).size() != qint64(expectedSize)) {
+        result.state = Result::Differs;
+        return result;
+    }
+
+    QFile file(debFile);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return result;
+    }
+
+    QCryptographicHash hash(QCryptographicHash::Sha256);
+    hash.addData(&file);
+    result.state = hash.result().toHex() == QByteArray::fromStdString(expectedHash) ? Result::Matches : Result::Differs;
+    return result;
+}
@@ -0,0 +1,47 @@
+/*
+ * Copyright (C) 2021 Cutefish Technology Co., Ltd.
+ *
+ * Author:     Reion Wong <reion@cutefishos.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef REPOSITORYCHECK_H
+#define REPOSITORYCHECK_H
+
+#include <QString>
+
+#include "targetroot.h"
+
+// 比较本地 deb 与已配置的软件源中同一包、同一版本发布的文件是否逐字节相同，
+// 期望的 SHA256 与大小来自 APT 缓存对应的 Packages 记录
+class RepositoryCheck
+{
+public:
+    struct Result {
+        enum State {
+            NotInRepository,  // 软件源中没有该版本，或记录中没有 SHA256
+            Matches,
+            Differs,
+        };
+
+        State state = NotInRepository;
+        QString package;
+        QString archive;  // 提供该版本的发行版，例如 "stable"
+    };
+
+    // 阻塞调用：先查找记录，大小不同时不再计算校验和
+    static Result check(const QString &debFile, const TargetRoot &root = TargetRoot());
+};
+
+#endif // REPOSITORYCHECK_H
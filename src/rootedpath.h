@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) 2021 Cutefish Technology Co., Ltd.
+ *
+ * Author:     Reion Wong <reion@cutefishos.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef ROOTEDPATH_H
+#define ROOTEDPATH_H
+
+#include <QByteArray>
+#include <QList>
+
+#include <cerrno>
+
+#include <fcntl.h>
+#include <linux/openat2.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// 在目录描述符 rootFd 之下按 chroot 的规则打开目录：路径中的绝对符号链接与 ".." 都不会离开 rootFd，
+// 包里的符号链接不能把之后的写入带到目标目录之外
+class RootedPath
+{
+public:
+    // path 相对于 rootFd，为空时打开 rootFd 本身；flags 为 O_PATH 或 O_RDONLY 等，总是加上 O_DIRECTORY 与 O_CLOEXEC。
+    // followLast 为 false 时最后一级是符号链接也拒绝。
+    // 5.6 之前的内核没有 openat2，逐级打开，任何一级是符号链接或 ".." 都拒绝
+    static int openDirectory(int rootFd, const QByteArray &path, int flags, bool followLast = true)
+    {
+        const char *name = path.isEmpty() ? "." : path.constData();
+
+        struct open_how how = {};
+        how.flags = flags | O_DIRECTORY | O_CLOEXEC | (followLast ? 0 : O_NOFOLLOW);
+        how.resolve = RESOLVE_IN_ROOT | RESOLVE_NO_MAGICLINKS;
+        const int fd = ::syscall(SYS_openat2, rootFd, name, &how, sizeof(how));
+        if (fd >= 0 || errno != ENOSYS) {
+            return fd;
+        }
+
+        int dir = ::fcntl(rootFd, F_DUPFD_CLOEXEC, 0);
+        for (const QByteArray &component : path.split('/')) {
+            if (dir < 0) {
+                return -1;
+            }
+            if (component.isEmpty() || component == ".") {
+                continue;
+            }
+            if (component == "..") {
+                ::close(dir);
+                errno = EPERM;
+                return -1;
+            }
+
+            const int next = ::openat(dir, component.constData(), O_PATH | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+            ::close(dir);
+            dir = next;
+        }
+
+        // 逐级打开的都是 O_PATH，最后按 flags 重新打开一次
+        if (dir >= 0 && (flags & O_PATH) == 0) {
+            const int reopened = ::openat(dir, ".", flags | O_DIRECTORY | O_CLOEXEC);
+            ::close(dir);
+            dir = reopened;
+        }
+        return dir;
+    }
+};
+
+#endif // ROOTEDPATH_H
@@ -0,0 +1,143 @@
+/*
+ * Copyright (C) 2021 Cutefish Technology Co., Ltd.
+ *
+ * Author:     Reion Wong <reion@cutefishos.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "singleinstance.h"
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QLockFile>
+#include <QDataStream>
+#include <QDeadlineTimer>
+#include <QThread>
+#include <QStandardPaths>
+#include <QDebug>
+
+#include <unistd.h>
+
+// 转交的消息格式，两端使用同一版本的 QDataStream 序列化文件列表
+static const QDataStream::Version StreamVersion = QDataStream::Qt_5_15;
+
+// 另一个进程持有锁但还没有开始监听时，最多等待这么久
+static const int ConnectTimeout = 5000;
+
+SingleInstance::SingleInstance(QObject *parent)
+    : QObject(parent)
+    , m_server(nullptr)
+    , m_lockFile(nullptr)
+{
+}
+
+SingleInstance::~SingleInstance()
+{
+    if (m_server) {
+        m_server->close();
+    }
+    delete m_lockFile;
+}
+
+QString SingleInstance::socketName()
+{
+    // 每个用户一个 socket，优先放在 XDG_RUNTIME_DIR 中
+    QString runtimeDir = QStandardPaths::writableLocation(QStandardPaths::RuntimeLocation);
+    if (!runtimeDir.isEmpty()) {
+        return runtimeDir + "/cutefish-debinstaller.socket";
+    }
+
+    return QString("cutefish-debinstaller-%1").arg(::getuid());
+}
+
+bool SingleInstance::listen()
+{
+    // 主实例在整个生命周期内持有锁，其他进程拿不到锁就说明已有实例；
+    // 锁只按进程是否存在判断是否残留，不会因为时间过长被别人抢走
+    QLockFile *lockFile = new QLockFile(socketName() + ".lock");
+    lockFile->setStaleLockTime(0);
+    if (!lockFile->tryLock()) {
+        delete lockFile;
+        return false;
+    }
+    m_lockFile = lockFile;
+
+    // 没有实例在运行，清理上次异常退出残留的 socket 文件
+    QLocalServer::removeServer(socketName());
+
+    m_server = new QLocalServer(this);
+    m_server->setSocketOptions(QLocalServer::UserAccessOption);
+    if (!m_server->listen(socketName())) {
+        qWarning() << "Failed to listen on" << socketName() << m_server->errorString();
+        return true;
+    }
+
+    connect(m_server, &QLocalServer::newConnection, this, &SingleInstance::onNewConnection);
+    return true;
+}
+
+bool SingleInstance::sendFiles(const QStringList &files)
+{
+    // 主实例可能刚拿到锁，还没有开始监听
+    QLocalSocket socket;
+    QDeadlineTimer deadline(ConnectTimeout);
+    forever {
+        socket.connectToServer(socketName());
+        if (socket.waitForConnected(deadline.remainingTime())) {
+            break;
+        }
+        if (deadline.hasExpired()) {
+            return false;
+        }
+        QThread::msleep(100);
+    }
+
+    // 空列表只用于唤醒已有窗口
+    QDataStream out(&socket);
+    out.setVersion(StreamVersion);
+    out << files;
+    if (!socket.waitForBytesWritten(1000)) {
+        return false;
+    }
+
+    socket.disconnectFromServer();
+    if (socket.state() != QLocalSocket::UnconnectedState) {
+        socket.waitForDisconnected(1000);
+    }
+
+    return true;
+}
+
+void SingleInstance::onNewConnection()
+{
+    while (QLocalSocket *socket = m_server->nextPendingConnection()) {
+        // 列表完整到达后立即处理，不等发送方断开
+        connect(socket, &QLocalSocket::readyRead, this, [this, socket]() {
+            QDataStream in(socket);
+            in.setVersion(StreamVersion);
+            in.startTransaction();
+
+            QStringList files;
+            in >> files;
+            if (!in.commitTransaction()) {
+                return;
+            }
+
+            socket->disconnect(this);
+            socket->disconnectFromServer();
+            socket->deleteLater();
+            emit filesReceived(files);
+        });
+        connect(socket, &QLocalSocket::disconnected, socket, &QObject::deleteLater);
+    }
+}
@@ -0,0 +1,57 @@
+/*
+ * Copyright (C) 2021 Cutefish Technology Co., Ltd.
+ *
+ * Author:     Reion Wong <reion@cutefishos.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef SINGLEINSTANCE_H
+#define SINGLEINSTANCE_H
+
+#include <QObject>
+#include <QString>
+#include <QStringList>
+
+class QLocalServer;
+class QLockFile;
+
+class SingleInstance : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit SingleInstance(QObject *parent = nullptr);
+    ~SingleInstance();
+
+    // 成为主实例返回 true；若已有实例在运行，则返回 false
+    bool listen();
+
+    // 将文件转交给正在运行的实例
+    bool sendFiles(const QStringList &files);
+
+signals:
+    void filesReceived(const QStringList &files);
+
+private slots:
+    void onNewConnection();
+
+private:
+    static QString socketName();
+
+private:
+    QLocalServer *m_server;
+    QLockFile *m_lockFile;
+};
+
+#endif // SINGLEINSTANCE_H
@@ -0,0 +1,320 @@
+/*
+ * Copyright (C) 2021 Cutefish Technology Co., Ltd.
+ *
+ * Author:     Reion Wong <reion@cutefishos.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "targetroot.h"
+#include <QDir>
+#include <QHash>
+#include <QMutex>
+#include <QWaitCondition>
+
+#include <apt-pkg/configuration.h>
+#include <apt-pkg/error.h>
+#include <apt-pkg/init.h>
+#include <apt-pkg/pkgsystem.h>
+
+namespace {
+
+const QString DefaultAdminDir = "/var/lib/dpkg";
+
+// 当前放在 _config 中的目标（主机为空）、进入其中的 Scope 数与事务固定的配置
+struct ConfigState {
+    QMutex mutex;
+    QWaitCondition changed;
+    QString activeKey;
+    int readers = 0;
+    int waiting = 0;
+    bool pinned = false;
+    Configuration *pinnedConfig = nullptr;
+    Configuration *hostConfig = nullptr;
+};
+
+ConfigState &state()
+{
+    static ConfigState state;
+    return state;
+}
+
+// 各目标的配置首次使用时创建，之后一直保留，只在持有 state().mutex 时访问
+QHash<QString, Configuration *> &rootConfigs()
+{
+    static QHash<QString, Configuration *> configs;
+    return configs;
+}
+
+// 只在没有 Scope 读取 _config 时调用
+void activate(ConfigState &state, const QString &key, Configuration *config)
+{
+    if (!state.hostConfig) {
+        state.hostConfig = _config;
+    }
+
+    const bool switched = key != state.activeKey;
+    _config = config;
+    state.activeKey = key;
+
+    // debSystem 缓存了 status 文件的索引，重新初始化后才会读取目标的 status
+    if (switched && _system) {
+        _system->Initialize(*_config);
+    }
+}
+
+// 空闲时恢复主机配置，已结束事务的配置此时才能删除
+void release(ConfigState &state)
+{
+    if (state.hostConfig) {
+        activate(state, QString(), state.hostConfig);
+    }
+    delete state.pinnedConfig;
+    state.pinnedConfig = nullptr;
+}
+
+// Configuration 没有可用的复制构造函数，逐项复制；列表项的 FullTag 以 "::" 结尾，Set 时会追加
+Configuration *copyOf(const Configuration &source)
+{
+    Configuration *copy = new Configuration;
+    const Configuration::Item *item = source.Tree(nullptr);
+    while (item) {
+        if (!item->Value.empty() || !item->Child) {
+            copy->Set(item->FullTag(), item->Value);
+        }
+
+        if (item->Child) {
+            item = item->Child;
+            continue;
+        }
+        while (item && !item->Next) {
+            item = item->Parent;
+        }
+        if (item) {
+            item = item->Next;
+        }
+    }
+    return copy;
+}
+
+// 同一线程内嵌套的 Scope 沿用最外层的配置和锁
+thread_local int scopeDepth = 0;
+
+// 本线程持有的 Pin 所固定的目标，用于发现会等待自己的调用
+thread_local bool pinHeld = false;
+thread_local QString pinnedKey;
+
+}
+
+TargetRoot::TargetRoot()
+{
+}
+
+TargetRoot::TargetRoot(const QString &rootDir, const QString &adminDir)
+{
+    const QString root = rootDir.isEmpty() ? QString() : QDir::cleanPath(QDir(rootDir).absolutePath());
+    if (root != "/") {
+        m_rootDir = root;
+    }
+
+    if (!adminDir.isEmpty()) {
+        m_adminDir = QDir::cleanPath(QDir(adminDir).absolutePath());
+    }
+}
+
+bool TargetRoot::isHost() const
+{
+    return m_rootDir.isEmpty() && (m_adminDir.isEmpty() || m_adminDir == DefaultAdminDir);
+}
+
+QString TargetRoot::rootDir() const
+{
+    return m_rootDir;
+}
+
+QString TargetRoot::adminDir() const
+{
+    return m_adminDir.isEmpty() ? m_rootDir + DefaultAdminDir : m_adminDir;
+}
+
+QString TargetRoot::path(const QString &path) const
+{
+    return m_rootDir + path;
+}
+
+QStringList TargetRoot::dpkgArguments() const
+{
+    if (isHost()) {
+        return QStringList();
+    }
+
+    QStringList arguments;
+    if (!m_rootDir.isEmpty()) {
+        arguments << "--root=" + m_rootDir;
+    }
+    arguments << "--admindir=" + adminDir();
+    return arguments;
+}
+
+void TargetRoot::insertInto(QVariantMap &options) const
+{
+    if (!isHost()) {
+        options["rootDir"] = m_rootDir;
+        options["adminDir"] = adminDir();
+    }
+}
+
+TargetRoot TargetRoot::fromOptions(const QVariantMap &options)
+{
+    return TargetRoot(options.value("rootDir").toString(), options.value("adminDir").toString());
+}
+
+bool TargetRoot::operator==(const TargetRoot &other) const
+{
+    return m_rootDir == other.m_rootDir && adminDir() == other.adminDir();
+}
+
+QString TargetRoot::key() const
+{
+    return isHost() ? QString() : m_rootDir + '\n' + adminDir();
+}
+
+Configuration *TargetRoot::configuration() const
+{
+    const QString key = this->key();
+    Configuration *config = rootConfigs().value(key);
+    if (config) {
+        return config;
+    }
+
+    // pkgInitConfig 只在 Dir 未设置时使用 "/"，这样 apt.conf、sources.list
+    // 以及 lists、pkgcache.bin 都来自目标内部
+    config = new Configuration;
+    config->Set("Dir", (m_rootDir.isEmpty() ? QString("/") : m_rootDir).toStdString());
+    if (!pkgInitConfig(*config)) {
+        _error->Discard();
+    }
+
+    config->Set("Dir::State::status", (adminDir() + "/status").toStdString());
+    for (const QString &argument : dpkgArguments()) {
+        config->Set("DPkg::Options::", argument.toStdString());
+    }
+
+    rootConfigs().insert(key, config);
+    return config;
+}
+
+Configuration *TargetRoot::copyConfiguration() const
+{
+    ConfigState &state = ::state();
+    QMutexLocker locker(&state.mutex);
+
+    // 还没有切换过目标时 _config 就是主机配置
+    if (!isHost()) {
+        return copyOf(*configuration());
+    }
+    return copyOf(state.hostConfig ? *state.hostConfig : *_config);
+}
+
+TargetRoot::Scope::Scope(const TargetRoot &root)
+    : m_outermost(scopeDepth++ == 0)
+{
+    if (!m_outermost) {
+        return;
+    }
+
+    ConfigState &state = ::state();
+    const QString key = root.key();
+    if (pinHeld && key != pinnedKey) {
+        qFatal("TargetRoot::Scope for another root entered while this thread holds a Pin");
+    }
+
+    QMutexLocker locker(&state.mutex);
+
+    // 同一目标直接进入，有人等待切换时先让它；事务固定配置期间同一目标不必等待。
+    // 另一个目标要等当前目标的 Scope 与事务都结束
+    if (key == state.activeKey) {
+        while (!state.pinned && state.waiting > 0) {
+            state.changed.wait(&state.mutex);
+        }
+    }
+    if (key != state.activeKey) {
+        ++state.waiting;
+        while (state.readers > 0 || state.pinned) {
+            state.changed.wait(&state.mutex);
+        }
+        --state.waiting;
+
+        if (key != state.activeKey) {
+            activate(state, key, root.isHost() ? state.hostConfig : root.configuration());
+        }
+    }
+
+    ++state.readers;
+}
+
+TargetRoot::Scope::~Scope()
+{
+    --scopeDepth;
+    if (!m_outermost) {
+        return;
+    }
+
+    ConfigState &state = ::state();
+    QMutexLocker locker(&state.mutex);
+    if (--state.readers == 0 && !state.pinned) {
+        release(state);
+    }
+    state.changed.wakeAll();
+}
+
+TargetRoot::Pin::Pin(const TargetRoot &root, Configuration *config)
+    : m_config(config)
+{
+    if (scopeDepth > 0 || pinHeld) {
+        qFatal("TargetRoot::Pin created while this thread holds a Scope or another Pin");
+    }
+
+    ConfigState &state = ::state();
+    QMutexLocker locker(&state.mutex);
+
+    // 换入配置时不能有 Scope 正在读取 _config
+    ++state.waiting;
+    while (state.readers > 0 || state.pinned) {
+        state.changed.wait(&state.mutex);
+    }
+    --state.waiting;
+
+    activate(state, root.key(), m_config);
+    state.pinned = true;
+    state.pinnedConfig = m_config;
+
+    pinHeld = true;
+    pinnedKey = root.key();
+}
+
+TargetRoot::Pin::~Pin()
+{
+    pinHeld = false;
+    pinnedKey.clear();
+
+    ConfigState &state = ::state();
+    QMutexLocker locker(&state.mutex);
+
+    // 同一目标的 Scope 可能还在读取这份配置，由最后一个 Scope 恢复并删除
+    state.pinned = false;
+    if (state.readers == 0) {
+        release(state);
+    }
+    state.changed.wakeAll();
+}
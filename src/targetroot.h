@@ -0,0 +1,96 @@
+/*
+ * Copyright (C) 2021 Cutefish Technology Co., Ltd.
+ *
+ * Author:     Reion Wong <reion@cutefishos.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef TARGETROOT_H
+#define TARGETROOT_H
+
+#include <QString>
+#include <QStringList>
+#include <QVariantMap>
+
+class Configuration;
+
+// 安装目标：主机，或者镜像构建、chroot 使用的另一个根目录。
+// libapt 的 _config 与 _system 是进程全局的，使用某个目标时需要在 Scope 内切换：
+// 同一目标的 Scope 可以并发，切换到另一个目标要等当前目标的 Scope 全部结束。
+// 因此不同目标的分析与提交实际上是排队进行的，这是 libapt 全局状态的限制。
+// Scope 只应包住打开缓存、求解这类短操作，不要跨越下载与 dpkg 运行
+class TargetRoot
+{
+public:
+    TargetRoot();
+    // adminDir 为空时使用 <rootDir>/var/lib/dpkg
+    explicit TargetRoot(const QString &rootDir, const QString &adminDir = QString());
+
+    bool isHost() const;
+    QString rootDir() const;
+    QString adminDir() const;
+
+    // 目标内的路径在主机上的位置
+    QString path(const QString &path) const;
+
+    // 传给 dpkg 的 --root 与 --admindir，主机为空
+    QStringList dpkgArguments() const;
+
+    // 安装选项中的 "rootDir"、"adminDir"
+    void insertInto(QVariantMap &options) const;
+    static TargetRoot fromOptions(const QVariantMap &options);
+
+    bool operator==(const TargetRoot &other) const;
+    bool operator!=(const TargetRoot &other) const { return !(*this == other); }
+
+    // 该目标配置的完整副本，事务在其上加入自己的选项后交给 Pin
+    Configuration *copyConfiguration() const;
+
+    class Scope
+    {
+    public:
+        explicit Scope(const TargetRoot &root);
+        ~Scope();
+
+    private:
+        Q_DISABLE_COPY(Scope)
+
+        bool m_outermost;
+    };
+
+    // 事务提交期间 APT 一直读取 _config，把事务自己的配置固定为全局配置直到析构。
+    // 同一目标的 Scope 仍然可以进入并读到这份配置，因此交出之后不能再修改；
+    // 其它目标要等事务结束。持有 Scope 或 Pin 的线程不能再创建 Pin，
+    // 持有 Pin 的线程也不能进入其它目标的 Scope，否则会等待自己，这两种情况直接终止
+    class Pin
+    {
+    public:
+        Pin(const TargetRoot &root, Configuration *config);
+        ~Pin();
+
+    private:
+        Q_DISABLE_COPY(Pin)
+
+        Configuration *m_config;
+    };
+
+private:
+    QString key() const;
+    Configuration *configuration() const;
+
+    QString m_rootDir;
+    QString m_adminDir;
+};
+
+#endif // TARGETROOT_H
@@ -0,0 +1,191 @@
+/*
+ * Copyright (C) 2021 Cutefish Technology Co., Ltd.
+ *
+ * Author:     Reion Wong <reion@cutefishos.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <QtTest>
+#include <QTemporaryDir>
+
+#include <apt-pkg/configuration.h>
+#include <apt-pkg/init.h>
+
+#include "debextractor.h"
+
+// 手工构造的 .deb：data.tar 不压缩，条目按给定顺序写入，dpkg-deb 无法生成这样的包
+class DebBuilder
+{
+public:
+    void addDirectory(const QByteArray &name)
+    {
+        addEntry(name, '5', QByteArray(), QByteArray(), 0755);
+    }
+
+    void addFile(const QByteArray &name, const QByteArray &data)
+    {
+        addEntry(name, '0', QByteArray(), data, 0644);
+    }
+
+    void addSymlink(const QByteArray &name, const QByteArray &target)
+    {
+        addEntry(name, '2', target, QByteArray(), 0777);
+    }
+
+    void addHardLink(const QByteArray &name, const QByteArray &target)
+    {
+        addEntry(name, '1', target, QByteArray(), 0644);
+    }
+
+    bool write(const QString &fileName) const
+    {
+        DebBuilder control;
+        control.addFile("./control", "Package: crafted\nVersion: 1.0\nArchitecture: all\n"
+                                     "Maintainer: Test <test@example.com>\nDescription: crafted\n");
+
+        QByteArray deb = "!<arch>\n";
+        appendMember(deb, "debian-binary", "2.0\n");
+        appendMember(deb, "control.tar", control.tar());
+        appendMember(deb, "data.tar", tar());
+
+        QFile file(fileName);
+        return file.open(QIODevice::WriteOnly) && file.write(deb) == deb.size();
+    }
+
+private:
+    void addEntry(const QByteArray &name, char type, const QByteArray &link, const QByteArray &data, int mode)
+    {
+        QByteArray header(512, '\0');
+        auto field = [&header](int offset, int size, const QByteArray &value) {
+            header.replace(offset, qMin<int>(value.size(), size), value.left(size));
+        };
+        auto octal = [&field](int offset, int size, qint64 value) {
+            field(offset, size, QByteArray::number(value, 8).rightJustified(size - 1, '0'));
+        };
+
+        field(0, 100, name);
+        octal(100, 8, mode);
+        octal(108, 8, 0);
+        octal(116, 8, 0);
+        octal(124, 12, data.size());
+        octal(136, 12, 1600000000);
+        header[156] = type;
+        field(157, 100, link);
+        field(257, 6, QByteArray("ustar", 6));
+        field(263, 2, "00");
+
+        // 校验和按校验和字段为空格计算
+        header.replace(148, 8, QByteArray(8, ' '));
+        int sum = 0;
+        for (char c : header) {
+            sum += static_cast<unsigned char>(c);
+        }
+        field(148, 8, QByteArray::number(sum, 8).rightJustified(6, '0') + '\0' + ' ');
+
+        m_tar += header;
+        m_tar += data;
+        m_tar += QByteArray((512 - data.size() % 512) % 512, '\0');
+    }
+
+    QByteArray tar() const
+    {
+        return m_tar + QByteArray(1024, '\0');
+    }
+
+    static void appendMember(QByteArray &deb, const QByteArray &name, const QByteArray &data)
+    {
+        deb += name.leftJustified(16, ' ');
+        deb += QByteArray("1600000000").leftJustified(12, ' ');
+        deb += QByteArray("0").leftJustified(6, ' ');
+        deb += QByteArray("0").leftJustified(6, ' ');
+        deb += QByteArray("100644").leftJustified(8, ' ');
+        deb += QByteArray::number(data.size()).leftJustified(10, ' ');
+        deb += "`\n";
+        deb += data;
+        if (data.size() % 2) {
+            deb += '\n';
+        }
+    }
+
+    QByteArray m_tar;
+};
+
+class TestDebExtractor : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase()
+    {
+        QVERIFY(pkgInitConfig(*_config));
+    }
+
+    void extractsRegularContent()
+    {
+        QTemporaryDir work;
+        DebBuilder builder;
+        builder.addDirectory("./usr/");
+        builder.addDirectory("./usr/share/");
+        builder.addFile("./usr/share/hello", "hello\n");
+        builder.addSymlink("./usr/share/link", "hello");
+        builder.addHardLink("./usr/share/hard", "./usr/share/hello");
+        QVERIFY(builder.write(work.filePath("test.deb")));
+
+        const DebExtractor::Result result = DebExtractor::extract(work.filePath("test.deb"), work.filePath("root"));
+        QVERIFY2(result.success, qPrintable(result.errorString));
+
+        QFile hello(work.filePath("root/usr/share/hello"));
+        QVERIFY(hello.open(QIODevice::ReadOnly));
+        QCOMPARE(hello.readAll(), QByteArray("hello\n"));
+        QCOMPARE(QFileInfo(work.filePath("root/usr/share/link")).symLinkTarget(), hello.fileName());
+        QVERIFY(QFile::exists(work.filePath("root/usr/share/hard")));
+    }
+
+    // 包中的符号链接指向目标之外，之后的条目经过它写入
+    void symlinkDoesNotEscape_data()
+    {
+        QTest::addColumn<bool>("absolute");
+        QTest::newRow("absolute") << true;
+        QTest::newRow("relative") << false;
+    }
+
+    void symlinkDoesNotEscape()
+    {
+        QFETCH(bool, absolute);
+
+        QTemporaryDir work;
+        QVERIFY(QDir(work.path()).mkdir("outside"));
+        const QByteArray outside = QFile::encodeName(work.filePath("outside"));
+
+        DebBuilder builder;
+        builder.addSymlink("./foo", absolute ? outside : QByteArray("../outside"));
+        builder.addFile("./foo/passwd", "owned\n");
+        builder.addFile("./foo/large", QByteArray(5 * 1024 * 1024, 'x'));
+        builder.addDirectory("./foo/dir/");
+        builder.addSymlink("./foo/link", "/etc/passwd");
+        builder.addFile("./bar", "bar\n");
+        builder.addHardLink("./foo/hard", "./bar");
+        QVERIFY(builder.write(work.filePath("test.deb")));
+
+        DebExtractor::extract(work.filePath("test.deb"), work.filePath("root"));
+
+        // 解压可以失败，也可以写到目标之内，但不能在目标之外留下任何东西
+        QCOMPARE(QDir(work.filePath("outside")).entryList(QDir::AllEntries | QDir::NoDotAndDotDot | QDir::System),
+                 QStringList());
+    }
+};
+
+QTEST_GUILESS_MAIN(TestDebExtractor)
+
+#include "tst_debextractor.moc"